@@ -0,0 +1,28 @@
+#!/bin/bash
+
+#
+# misura la latenza di avvio di farm: tempo medio di molte esecuzioni brevi
+# su un solo file piccolo, con il socket e con i ring (-r)
+#
+# uso: ./bench.sh [numero di esecuzioni] (default 200)
+#
+
+if [ ! -e generafile ] || [ ! -e farm ];
+then
+    echo "Compilare farm e generafile, eseguibili mancanti!"
+    exit 1
+fi
+
+runs=${1:-200}
+./generafile bench.dat 8 > /dev/null
+
+for mode in "" "-r"; do
+    start=$(date +%s%N)
+    for ((i = 0; i < runs; i++)); do
+	./farm $mode -n 4 bench.dat > /dev/null
+    done
+    end=$(date +%s%N)
+    echo "farm ${mode:-(socket)}: $(( (end - start) / runs / 1000 )) us per esecuzione su $runs"
+done
+
+rm -f bench.dat
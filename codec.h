@@ -0,0 +1,91 @@
+#if !defined(CODEC_H)
+#define CODEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/** Formato compatto per i file di interi long.
+ *
+ *  header:  magic "FRMZ" | block_len (u32) | nelem (u64)
+ *  blocco:  base (i64) | width (u8) | block_len valori da width byte
+ *
+ *  Ogni blocco e' codificato frame-of-reference: i valori sono salvati come
+ *  scostamento (senza segno) dal minimo del blocco, su 0, 1, 2, 4 o 8 byte.
+ *  L'ultimo blocco puo' contenere meno di block_len valori.
+ *  Tutti i campi sono in ordine di byte dell'host.
+ */
+
+#define CODEC_MAGIC      "FRMZ"
+#define CODEC_MAGIC_LEN  4
+#define CODEC_BLOCK_LEN  128
+
+typedef struct codec_header {
+    char      magic[CODEC_MAGIC_LEN];
+    uint32_t  block_len;
+    uint64_t  nelem;
+} codec_header_t;
+
+#define CODEC_BLOCK_HDR  (sizeof(int64_t) + sizeof(uint8_t))
+
+
+/** Stato della decodifica incrementale: permette di elaborare il file
+ *  a pezzi (blocchi interi) invece che tutto in una volta.
+ */
+typedef struct codec_cursor {
+    uint64_t  idx;      // indice del prossimo valore da decodificare
+    uint64_t  nelem;
+    size_t    off;      // offset nel file del prossimo blocco
+    uint64_t  acc;      // somma parziale
+} codec_cursor_t;
+
+#define CODEC_MAX_BLOCK  (CODEC_BLOCK_HDR + CODEC_BLOCK_LEN * sizeof(uint64_t))
+
+
+/** Controlla se il contenuto mappato inizia con l'header del formato compatto
+ *  e se \param size, la dimensione dell'intero file, e' compatibile con il
+ *  numero di valori e di blocchi dichiarati. \param content deve contenere
+ *  almeno l'header; un file che non supera il controllo si legge come long.
+ *
+ *   \retval 1 se il file e' codificato
+ *   \retval 0 altrimenti
+ */
+int codecIsEncoded(const void *content, size_t size);
+
+/** Calcola la somma di i*file[i] decodificando il file blocco per blocco.
+ *  Il risultato coincide con quello calcolato sul formato long non codificato.
+ *
+ *   \retval 0 se successo
+ *   \retval -1 se il file e' malformato (errno settato a EINVAL)
+ */
+int codecSum(const void *content, size_t size, long *result);
+
+/** Legge l'header (all'inizio di \param content, lungo \param size come per
+ *  codecIsEncoded) e inizializza il cursore.
+ *
+ *   \retval 0 se successo
+ *   \retval -1 se l'header non e' valido (errno settato a EINVAL)
+ */
+int codecBegin(const void *content, size_t size, codec_cursor_t *c);
+
+/** Decodifica i blocchi interi contenuti nei \param avail byte puntati da \param p,
+ *  che corrispondono all'offset c->off del file. \param eof indica che dopo
+ *  quei byte il file finisce, quindi un blocco troncato e' un errore.
+ *
+ *   \retval n byte consumati (0 se non c'e' nemmeno un blocco intero)
+ *   \retval -1 se il file e' malformato (errno settato a EINVAL)
+ */
+long codecStep(codec_cursor_t *c, const void *p, size_t avail, int eof);
+
+/** Vero quando tutti i valori sono stati decodificati; il risultato e' (long)c->acc.
+ */
+static inline int codecDone(const codec_cursor_t *c) { return c->idx >= c->nelem; }
+
+/** Scrive su \param fp l'header e i blocchi che codificano \param nelem valori.
+ *
+ *   \retval 0 se successo
+ *   \retval -1 se errore (errno settato opportunamente)
+ */
+int codecWrite(FILE *fp, const long *v, size_t nelem);
+
+#endif /* CODEC_H */
@@ -0,0 +1,524 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "util.h"
+#include "codec.h"
+#include "engine.h"
+
+/**
+ * @file engine.c
+ * @brief File di implementazione del motore del farm (pool di Worker)
+ */
+
+typedef struct farm_worker {
+    size_t          id;
+    farm_engine_t  *e;
+} farm_worker_t;
+
+struct farm_engine {
+    PQueue_t        *q;
+    throttle_t      *thr;
+    membudget_t     *budget;
+    size_t           window;    // multiplo della pagina
+    size_t           page;
+    farm_result_cb   cb;
+    void            *arg;
+    farm_type_t      type;      // dei task creati da farmSubmitFile/farmSubmitBuffer
+    int              be;
+    size_t           nthreads;
+    size_t           started;   // i Worker partono uno per task, fino a nthreads
+    pthread_t       *th;
+    farm_worker_t   *w;
+    size_t           pending;   // task inseriti e non ancora consegnati alla callback
+    int              closed;
+    _Atomic int      cancelled; // letto dai Worker a ogni pezzo del file
+    pthread_mutex_t  m;
+    pthread_cond_t   c;
+};
+
+// finestra mappata di un file: un Worker non tiene mai mappati piu' di e->window byte
+typedef struct map_window {
+    int          fd;
+    size_t       filesize;
+    size_t       off;       // offset nel file dell'inizio della finestra, allineato alla pagina
+    size_t       len;
+    size_t       dropped;   // byte all'inizio della finestra gia' restituiti con MADV_DONTNEED
+    const char  *p;         // NULL se non c'e' nessuna finestra mappata
+} map_window_t;
+
+
+/* ------------------- kernel specializzati -------------------- */
+
+// somme parziali di un task, una per ogni indice modulo FARM_LANES
+typedef struct lanes {
+    uint64_t  u[FARM_LANES];
+    double    f[FARM_LANES];
+} lanes_t;
+
+typedef void (*kernel_t)(const unsigned char *p, uint64_t i0, size_t n, lanes_t *acc);
+
+#define NOSWAP(x) (x)
+
+#define MUL_INT(i, x)  ((uint64_t)(i) * (uint64_t)(int64_t)(x))
+#define MUL_FLT(i, x)  ((double)(i) * (x))
+
+/* Un kernel per ogni tipo e ordine dei byte: la lettura (memcpy, gia' allineata
+ * o no), lo scambio dei byte e il prodotto sono fissati a tempo di compilazione.
+ * Il corpo principale elabora FARM_LANES elementi alla volta su accumulatori
+ * indipendenti, che il compilatore puo' tenere in un registro vettoriale. */
+#define DEFINE_KERNEL(NAME, T, U, SWAP, ACC, FIELD, MUL)			\
+    static void NAME(const unsigned char *p, uint64_t i0, size_t n, lanes_t *acc) { \
+	ACC a[FARM_LANES];							\
+	for (unsigned l = 0; l < FARM_LANES; l++) a[l] = acc->FIELD[l];	\
+	size_t k = 0;								\
+	for (; k < n && ((i0 + k) % FARM_LANES) != 0; k++) {			\
+	    U raw; T x;								\
+	    memcpy(&raw, p + k * sizeof(U), sizeof(U));			\
+	    raw = SWAP(raw);							\
+	    memcpy(&x, &raw, sizeof(x));					\
+	    a[(i0 + k) % FARM_LANES] += MUL(i0 + k, x);			\
+	}									\
+	for (; k + FARM_LANES <= n; k += FARM_LANES) {				\
+	    for (unsigned l = 0; l < FARM_LANES; l++) {			\
+		U raw; T x;							\
+		memcpy(&raw, p + (k + l) * sizeof(U), sizeof(U));		\
+		raw = SWAP(raw);						\
+		memcpy(&x, &raw, sizeof(x));					\
+		a[l] += MUL(i0 + k + l, x);					\
+	    }									\
+	}									\
+	for (; k < n; k++) {							\
+	    U raw; T x;								\
+	    memcpy(&raw, p + k * sizeof(U), sizeof(U));			\
+	    raw = SWAP(raw);							\
+	    memcpy(&x, &raw, sizeof(x));					\
+	    a[(i0 + k) % FARM_LANES] += MUL(i0 + k, x);			\
+	}									\
+	for (unsigned l = 0; l < FARM_LANES; l++) acc->FIELD[l] = a[l];	\
+    }
+
+DEFINE_KERNEL(sum_i64_le, int64_t,  uint64_t, NOSWAP,            uint64_t, u, MUL_INT)
+DEFINE_KERNEL(sum_i64_be, int64_t,  uint64_t, __builtin_bswap64, uint64_t, u, MUL_INT)
+DEFINE_KERNEL(sum_i32_le, int32_t,  uint32_t, NOSWAP,            uint64_t, u, MUL_INT)
+DEFINE_KERNEL(sum_i32_be, int32_t,  uint32_t, __builtin_bswap32, uint64_t, u, MUL_INT)
+DEFINE_KERNEL(sum_u64_le, uint64_t, uint64_t, NOSWAP,            uint64_t, u, MUL_INT)
+DEFINE_KERNEL(sum_u64_be, uint64_t, uint64_t, __builtin_bswap64, uint64_t, u, MUL_INT)
+DEFINE_KERNEL(sum_f64_le, double,   uint64_t, NOSWAP,            double,   f, MUL_FLT)
+DEFINE_KERNEL(sum_f64_be, double,   uint64_t, __builtin_bswap64, double,   f, MUL_FLT)
+
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#error "i kernel assumono un host little-endian"
+#endif
+
+static const kernel_t Kernel[FARM_NTYPES][2] = {
+    [FARM_I64] = { sum_i64_le, sum_i64_be },
+    [FARM_I32] = { sum_i32_le, sum_i32_be },
+    [FARM_U64] = { sum_u64_le, sum_u64_be },
+    [FARM_F64] = { sum_f64_le, sum_f64_be },
+};
+
+static const size_t Width[FARM_NTYPES] = { 8, 4, 8, 8 };
+
+static const char *TypeName[FARM_NTYPES] = { "i64", "i32", "u64", "f64" };
+
+// somma le corsie sempre nello stesso ordine e ritorna i 64 bit del risultato
+static long Reduce(farm_type_t type, const lanes_t *acc) {
+    if (type == FARM_F64) {
+	double f = (acc->f[0] + acc->f[1]) + (acc->f[2] + acc->f[3]);
+	long bits;
+	memcpy(&bits, &f, sizeof(bits));
+	return bits;
+    }
+    return (long)(acc->u[0] + acc->u[1] + acc->u[2] + acc->u[3]);
+}
+
+/* ------------------- funzioni di utilita' -------------------- */
+
+static inline int Cancelled(farm_engine_t *e) {
+    return atomic_load_explicit(&e->cancelled, memory_order_relaxed);
+}
+
+static void WindowUnmap(farm_engine_t *e, map_window_t *w) {
+    if (w->p == NULL) return;
+    munmap((void *)w->p, w->len);
+    budgetRelease(e->budget, w->len);
+    w->p = NULL;
+}
+
+// mappa la finestra che inizia dalla pagina di pos, dopo aver tolto la precedente;
+// la dimensione della finestra viene prenotata sul budget globale
+static int WindowMap(farm_engine_t *e, map_window_t *w, size_t pos) {
+    WindowUnmap(e, w);
+    w->off = pos - pos % e->page;
+    w->len = w->filesize - w->off < e->window ? w->filesize - w->off : e->window;
+    w->dropped = 0;
+    if (budgetAcquire(e->budget, w->len) == -1) return -1;
+    void *p = mmap(0, w->len, PROT_READ, MAP_PRIVATE, w->fd, w->off);
+    if (p == MAP_FAILED) {
+	int myerrno = errno;
+	budgetRelease(e->budget, w->len);
+	errno = myerrno;
+	return -1;
+    }
+    madvise(p, w->len, MADV_SEQUENTIAL);
+    w->p = p;
+    return 0;
+}
+
+// restituisce al sistema le pagine della finestra prima di pos, gia' elaborate
+static void WindowConsumed(farm_engine_t *e, map_window_t *w, size_t pos) {
+    size_t upto = pos - w->off;
+    upto -= upto % e->page;
+    if (upto <= w->dropped) return;
+    madvise((void *)(w->p + w->dropped), upto - w->dropped, MADV_DONTNEED);
+    w->dropped = upto;
+}
+
+static int ComputeFile(farm_engine_t *e, farm_task_t *t) {
+    t->result = 0;
+    if (t->type >= FARM_NTYPES) {
+	errno = EINVAL;
+	return -1;
+    }
+    if (t->size == 0) return 0;    // la mmap di 0 byte fallirebbe
+
+    map_window_t w = { -1, t->size, 0, 0, 0, NULL };
+    w.fd = open(t->filename, O_RDONLY);
+    if (w.fd == -1) return -1;
+    if (WindowMap(e, &w, 0) == -1) goto error;
+
+    // il formato compatto esiste solo per i long nell'ordine dell'host
+    // (la prima finestra e' di almeno due pagine: contiene tutto l'header)
+    if (t->type == FARM_I64 && !t->be && codecIsEncoded(w.p, t->size)) {
+	codec_cursor_t c;
+	if (codecBegin(w.p, t->size, &c) == -1) goto error;
+	while (!codecDone(&c)) {
+	    // un blocco non deve mai restare a cavallo della fine della finestra
+	    if (w.off + w.len - c.off < CODEC_MAX_BLOCK && w.off + w.len < t->size &&
+		WindowMap(e, &w, c.off) == -1)
+		goto error;
+	    size_t wend = w.off + w.len;
+	    size_t avail = wend - c.off < CHUNK_BYTES ? wend - c.off : CHUNK_BYTES;
+	    long used = codecStep(&c, w.p + (c.off - w.off), avail, c.off + avail == t->size);
+	    if (used == -1) goto error;
+	    // i byte letti sono quelli codificati: il limite vale per il disco, non per i valori.
+	    // Si paga solo cio' che codecStep ha consumato: il blocco incompleto in coda
+	    // al pezzo viene riletto (e pagato) al giro successivo
+	    throttleBytes(e->thr, used);
+	    if (Cancelled(e)) {
+		errno = ECANCELED;
+		goto error;
+	    }
+	    WindowConsumed(e, &w, c.off);
+	}
+	t->result = (long)c.acc;
+    } else {
+	kernel_t K = Kernel[t->type][t->be != 0];
+	size_t width = Width[t->type];
+	lanes_t acc = {{0}};
+	size_t nelem = t->size / width;
+	for (size_t i = 0; i < nelem;) {
+	    if (i * width >= w.off + w.len && WindowMap(e, &w, i * width) == -1) goto error;
+	    // la finestra inizia a un multiplo della pagina, quindi della larghezza
+	    size_t base = w.off / width;
+	    size_t wend = (w.off + w.len) / width < nelem ? (w.off + w.len) / width : nelem;
+	    while (i < wend) {
+		size_t end = wend - i < CHUNK_BYTES / width ? wend : i + CHUNK_BYTES / width;
+		throttleBytes(e->thr, (end - i) * width);
+		// un pezzo costa al piu' CHUNK_BYTES: l'annullamento arriva entro un pezzo
+		if (Cancelled(e)) {
+		    errno = ECANCELED;
+		    goto error;
+		}
+		K((const unsigned char *)w.p + (i - base) * width, i, end - i, &acc);
+		i = end;
+		WindowConsumed(e, &w, i * width);
+	    }
+	}
+	t->result = Reduce(t->type, &acc);
+    }
+    WindowUnmap(e, &w);
+    close(w.fd);
+    return 0;
+ error:;
+    int myerrno = errno;
+    WindowUnmap(e, &w);
+    close(w.fd);
+    errno = myerrno;
+    return -1;
+}
+
+// il buffer e' gia' in memoria: niente finestre, budget ne' limitatore
+static int ComputeBuffer(farm_task_t *t) {
+    if (t->type >= FARM_NTYPES) {
+	errno = EINVAL;
+	return -1;
+    }
+    if (t->type == FARM_I64 && !t->be && codecIsEncoded(t->buf, t->size))
+	return codecSum(t->buf, t->size, &t->result);
+    lanes_t acc = {{0}};
+    Kernel[t->type][t->be != 0](t->buf, 0, t->size / Width[t->type], &acc);
+    t->result = Reduce(t->type, &acc);
+    return 0;
+}
+
+static void Deliver(farm_engine_t *e, size_t worker, farm_task_t *t) {
+    int owned = t->owned;
+    e->cb(worker, t, e->arg);
+    if (owned) {
+	free(t->filename);
+	free(t);
+    }
+    LOCK(&e->m);
+    e->pending -= 1;
+    if (e->pending == 0) BCAST(&e->c);
+    UNLOCK(&e->m);
+}
+
+static void *Worker(void *arg) {
+    farm_worker_t *w = arg;
+    farm_engine_t *e = w->e;
+    while (1) {
+	farm_task_t *t = pqPop(e->q);
+	if (t == NULL) break;   // ingresso chiuso e coda vuota
+	t->err = 0;
+	if (Cancelled(e)) {
+	    t->err = ECANCELED;   // i task rimasti in coda tornano al chiamante senza calcolo
+	} else if (!t->done) {
+	    if (t->filename) {
+		throttleFile(e->thr);
+		if (ComputeFile(e, t) == -1) t->err = errno;
+	    } else if (ComputeBuffer(t) == -1) {
+		t->err = errno;
+	    }
+	}
+	Deliver(e, w->id, t);
+    }
+    return NULL;
+}
+
+/* ------------------- interfaccia del motore ------------------ */
+
+farm_engine_t *initFarm(const farm_opts_t *o) {
+    if (!o || !o->cb || o->q_len == 0 || o->window < 0 || o->type >= FARM_NTYPES) {
+	errno = EINVAL;
+	return NULL;
+    }
+    farm_engine_t *e = calloc(1, sizeof(farm_engine_t));
+    if (!e) return NULL;
+    e->thr = o->thr;
+    e->budget = o->budget;
+    e->cb = o->cb;
+    e->arg = o->arg;
+    e->type = o->type;
+    e->be = o->be;
+    e->nthreads = o->nthreads;
+    e->page = sysconf(_SC_PAGESIZE);
+    size_t window = o->window ? (size_t)o->window : MAP_WINDOW;
+    if (e->budget && window > e->budget->limit) window = e->budget->limit;
+    e->window = window - window % e->page;
+    // da ogni offset devono restare almeno CODEC_MAX_BLOCK byte mappati
+    if (e->window < 2 * e->page) {
+	free(e);
+	errno = EINVAL;
+	return NULL;
+    }
+    e->th = calloc(e->nthreads ? e->nthreads : 1, sizeof(pthread_t));
+    e->w = calloc(e->nthreads ? e->nthreads : 1, sizeof(farm_worker_t));
+    if (!e->th || !e->w) goto error;
+    if ((e->q = initPQueue(o->q_len, o->nclasses ? o->nclasses : 1, o->weights)) == NULL) goto error;
+    if (pthread_mutex_init(&e->m, NULL) != 0) goto error;
+    if (pthread_cond_init(&e->c, NULL) != 0) {
+	pthread_mutex_destroy(&e->m);
+	goto error;
+    }
+    return e;
+ error:;
+    int myerrno = errno;
+    if (e->q) deletePQueue(e->q, NULL);
+    free(e->th);
+    free(e->w);
+    free(e);
+    errno = myerrno;
+    return NULL;
+}
+
+int farmSubmit(farm_engine_t *e, farm_task_t *t) {
+    if (!e || !t || (!t->filename && !t->buf && t->size) || t->prio >= e->q->nclasses) {
+	errno = EINVAL;
+	return -1;
+    }
+    LOCK(&e->m);
+    if (e->closed) {
+	UNLOCK(&e->m);
+	errno = Cancelled(e) ? ECANCELED : EPIPE;
+	return -1;
+    }
+    // un nuovo Worker finche' non sono partiti tutti: pochi task, pochi thread
+    if (e->started < e->nthreads) {
+	size_t i = e->started;
+	e->w[i].id = i;
+	e->w[i].e = e;
+	int r = pthread_create(&e->th[i], NULL, Worker, &e->w[i]);
+	if (r != 0) {
+	    UNLOCK(&e->m);
+	    errno = r;
+	    return -1;
+	}
+	e->started += 1;
+    }
+    e->pending += 1;
+    UNLOCK(&e->m);
+    if (pqPush(e->q, t->prio, t) == 0) return 0;
+    // la coda e' stata chiusa mentre il chiamante aspettava un posto
+    LOCK(&e->m);
+    e->pending -= 1;
+    if (e->pending == 0) BCAST(&e->c);
+    UNLOCK(&e->m);
+    errno = Cancelled(e) ? ECANCELED : EPIPE;
+    return -1;
+}
+
+static int SubmitOwned(farm_engine_t *e, uint64_t id, const char *name, const void *buf, size_t size, void *udata) {
+    farm_task_t *t = calloc(1, sizeof(farm_task_t));
+    if (!t) return -1;
+    t->id = id;
+    t->type = e->type;
+    t->be = e->be;
+    t->buf = buf;
+    t->size = size;
+    t->udata = udata;
+    t->owned = 1;
+    if (name && (t->filename = strdup(name)) == NULL) goto error;
+    if (farmSubmit(e, t) == -1) goto error;
+    return 0;
+ error:;
+    int myerrno = errno;
+    free(t->filename);
+    free(t);
+    errno = myerrno;
+    return -1;
+}
+
+int farmSubmitFile(farm_engine_t *e, uint64_t id, const char *name, size_t size, void *udata) {
+    if (!name) {
+	errno = EINVAL;
+	return -1;
+    }
+    return SubmitOwned(e, id, name, NULL, size, udata);
+}
+
+int farmSubmitBuffer(farm_engine_t *e, uint64_t id, const void *buf, size_t size, void *udata) {
+    return SubmitOwned(e, id, NULL, buf, size, udata);
+}
+
+void farmDrain(farm_engine_t *e) {
+    if (!e) return;
+    LOCK(&e->m);
+    while (e->pending > 0)
+	WAIT(&e->c, &e->m);
+    UNLOCK(&e->m);
+}
+
+void farmClose(farm_engine_t *e) {
+    if (!e) return;
+    LOCK(&e->m);
+    int closed = e->closed;
+    e->closed = 1;
+    UNLOCK(&e->m);
+    if (!closed) pqClose(e->q);
+}
+
+void farmCancel(farm_engine_t *e) {
+    if (!e) return;
+    atomic_store(&e->cancelled, 1);
+    throttleCancel(e->thr);
+    budgetCancel(e->budget);
+    farmClose(e);
+    // senza Worker ne' esecutori esterni nessuno estrarrebbe i task rimasti:
+    // la coda e' chiusa, quindi l'estrazione non aspetta
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    farm_task_t *t;
+    while ((t = pqTimedPop(e->q, &now)) != NULL) {
+	t->err = ECANCELED;
+	Deliver(e, FARM_NO_EXECUTOR, t);
+    }
+}
+
+void deleteFarm(farm_engine_t *e) {
+    if (!e) return;
+    farmClose(e);
+    for (size_t i = 0; i < e->started; i++)
+	pthread_join(e->th[i], NULL);
+    deletePQueue(e->q, NULL);
+    pthread_mutex_destroy(&e->m);
+    pthread_cond_destroy(&e->c);
+    free(e->th);
+    free(e->w);
+    free(e);
+}
+
+farm_task_t *farmTake(farm_engine_t *e, const struct timespec *abstime) {
+    if (!e || !abstime) {
+	errno = EINVAL;
+	return NULL;
+    }
+    farm_task_t *t;
+    while ((t = pqTimedPop(e->q, abstime)) != NULL && Cancelled(e)) {
+	t->err = ECANCELED;
+	Deliver(e, FARM_NO_EXECUTOR, t);
+    }
+    return t;
+}
+
+void farmComplete(farm_engine_t *e, size_t executor, farm_task_t *t) {
+    if (e && t) Deliver(e, executor, t);
+}
+
+int farmRequeue(farm_engine_t *e, farm_task_t *t) {
+    if (!e || !t) {
+	errno = EINVAL;
+	return -1;
+    }
+    if (pqPush(e->q, t->prio, t) == 0) return 0;
+    if (!Cancelled(e)) return -1;
+    // dopo farmCancel il task non verra' piu' eseguito: torna subito al chiamante
+    t->err = ECANCELED;
+    Deliver(e, FARM_NO_EXECUTOR, t);
+    return 0;
+}
+
+void farmStats(farm_engine_t *e, size_t cls, pq_stats_t *out) {
+    if (e) pqStats(e->q, cls, out);
+}
+
+int farmTypeByName(const char *name) {
+    for (int i = 0; name && i < FARM_NTYPES; i++)
+	if (strcmp(name, TypeName[i]) == 0) return i;
+    return -1;
+}
+
+int farmFormat(char *buf, size_t len, farm_type_t type, long result) {
+    switch (type) {
+    case FARM_U64:
+	return snprintf(buf, len, "%lu", (unsigned long)result);
+    case FARM_F64: {
+	double f;
+	memcpy(&f, &result, sizeof(f));
+	return snprintf(buf, len, "%.17g", f);
+    }
+    default:
+	return snprintf(buf, len, "%ld", result);
+    }
+}
@@ -0,0 +1,174 @@
+#if !defined(ENGINE_H)
+#define ENGINE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "membudget.h"
+#include "prioqueue.h"
+#include "throttle.h"
+
+/** Motore del farm: un pool di Worker che calcolano la somma di i*file[i]
+ *  (long, formato compatto o uno dei tipi di farm_type_t, anche big-endian) su
+ *  file o buffer in memoria.
+ *
+ *  Il pool si crea una volta e si riusa per un numero qualsiasi di task: i
+ *  thread partono con i primi task e restano vivi fino a deleteFarm. Ogni
+ *  risultato viene consegnato alla callback, chiamata dal thread che lo ha
+ *  calcolato. I file vengono mappati una finestra alla volta (vedi -w e -m).
+ *  La coda ha una o piu' classi di priorita', servite con un round-robin pesato.
+ */
+
+#if !defined(CHUNK_BYTES)
+#define CHUNK_BYTES (1L << 20) // i Worker leggono i file a pezzi di questa dimensione
+#endif
+#if !defined(MAP_WINDOW)
+#define MAP_WINDOW (16L << 20) // byte di un file mappati al massimo da un Worker
+#endif
+
+/** Tipo degli elementi del file e larghezza dell'accumulatore. Le somme intere
+ *  sono modulo 2^64; quella in virgola mobile usa FARM_LANES somme parziali,
+ *  una per ogni indice modulo FARM_LANES, sommate a coppie alla fine: il
+ *  risultato non dipende dalla finestra ne' dalla dimensione dei pezzi.
+ */
+typedef enum farm_type {
+    FARM_I64 = 0,   // long (il formato compatto e' solo di questo tipo), accumulatore int64
+    FARM_I32,       // int32, accumulatore int64
+    FARM_U64,       // uint64, accumulatore uint64
+    FARM_F64,       // double, accumulatore double
+    FARM_NTYPES
+} farm_type_t;
+
+#define FARM_LANES 4
+
+#define FARM_NO_EXECUTOR ((size_t)-1)
+
+typedef struct farm_task {
+    uint64_t     id;        // scelto dal chiamante, il motore non lo usa
+    char        *filename;  // NULL per i task su buffer
+    const void  *buf;       // contenuto del task su buffer
+    size_t       size;      // dimensione in byte del file o del buffer
+    unsigned     prio;      // classe di priorita' (0 la piu' urgente)
+    farm_type_t  type;
+    int          be;        // 1 se gli elementi sono big-endian
+    int          done;      // 1 se il risultato e' gia' noto: il Worker lo inoltra soltanto
+    long         result;    // i 64 bit del risultato, da interpretare secondo type (farmFormat)
+    int          err;       // 0, oppure l'errno che ha impedito il calcolo
+    void        *udata;     // dati del chiamante
+    int          owned;     // interno: task allocato da farmSubmitFile/farmSubmitBuffer
+} farm_task_t;
+
+/** Callback dei risultati. \param worker e' l'indice del Worker (0..nthreads-1)
+ *  o dell'esecutore esterno passato a farmComplete, oppure FARM_NO_EXECUTOR per
+ *  i task annullati da farmTake o farmRequeue. Per i task inseriti con
+ *  farmSubmit il task torna al chiamante: il motore non lo tocca piu'.
+ *  Dopo farmCancel i task non completati arrivano con err == ECANCELED.
+ */
+typedef void (*farm_result_cb)(size_t worker, farm_task_t *t, void *arg);
+
+typedef struct farm_opts {
+    size_t          nthreads;
+    size_t          q_len;    // posti nella coda, condivisi da tutte le classi
+    size_t          nclasses; // classi di priorita' (0 vuol dire una sola)
+    const unsigned *weights;  // estrazioni consecutive per classe, NULL per 1
+    long            window;   // 0 per MAP_WINDOW
+    throttle_t     *thr;      // NULL se la lettura non e' limitata
+    membudget_t    *budget;   // NULL se la memoria mappata non e' limitata
+    farm_type_t     type;     // tipo dei task creati da farmSubmitFile/farmSubmitBuffer
+    int             be;
+    farm_result_cb  cb;
+    void           *arg;
+} farm_opts_t;
+
+typedef struct farm_engine farm_engine_t;
+
+
+/** Crea il pool. Nessun thread parte finche' non arriva il primo task.
+ *
+ *   \retval NULL se errore (errno settato; EINVAL se la finestra, ridotta al
+ *           budget, e' piu' piccola di due pagine)
+ *   \retval e puntatore al motore
+ */
+farm_engine_t *initFarm(const farm_opts_t *o);
+
+/** Inserisce un task preparato dal chiamante (file o buffer), bloccandosi se la
+ *  coda e' piena. \param t deve restare valido fino alla callback.
+ *
+ *   \retval 0 se successo
+ *   \retval -1 se errore (errno settato opportunamente)
+ */
+int farmSubmit(farm_engine_t *e, farm_task_t *t);
+
+/** Come farmSubmit, ma il task (e la copia di \param name) li alloca il motore
+ *  e li libera dopo la callback.
+ */
+int farmSubmitFile(farm_engine_t *e, uint64_t id, const char *name, size_t size, void *udata);
+
+/** Come farmSubmitFile per un buffer in memoria, che deve restare valido fino
+ *  alla callback.
+ */
+int farmSubmitBuffer(farm_engine_t *e, uint64_t id, const void *buf, size_t size, void *udata);
+
+/** Aspetta che tutti i task inseriti finora abbiano consegnato il risultato.
+ *  Il pool resta utilizzabile.
+ */
+void farmDrain(farm_engine_t *e);
+
+/** Chiude l'ingresso: i Worker (e gli esecutori esterni) terminano dopo aver
+ *  elaborato i task gia' in coda. Con esecutori esterni va chiamata dopo
+ *  farmDrain, perche' possono rimettere in coda i task che non hanno completato.
+ */
+void farmClose(farm_engine_t *e);
+
+/** Annulla il lavoro in corso: chiude l'ingresso (farmSubmit fallisce con
+ *  ECANCELED), interrompe le attese sul limitatore e sul budget (che restano
+ *  annullati) e fa consegnare ogni task non ancora completato con err ==
+ *  ECANCELED. I task ancora in coda li consegna farmCancel stessa, cosi'
+ *  farmDrain ritorna anche senza Worker ne' esecutori esterni; un Worker
+ *  abbandona il file che sta elaborando entro CHUNK_BYTES byte e rilascia le
+ *  finestre mappate. Si puo' chiamare da un thread qualsiasi, anche mentre un
+ *  altro e' fermo in farmDrain o farmSubmit.
+ */
+void farmCancel(farm_engine_t *e);
+
+/** Chiude l'ingresso se non e' gia' chiuso, aspetta i Worker e libera il motore.
+ */
+void deleteFarm(farm_engine_t *e);
+
+/** Copia in \param out le statistiche d'attesa in coda della classe \param cls.
+ */
+void farmStats(farm_engine_t *e, size_t cls, pq_stats_t *out);
+
+/** Ritorna il tipo di nome \param name ("i32", "i64", "u64" o "f64").
+ *
+ *   \retval -1 se il nome non e' valido
+ */
+int farmTypeByName(const char *name);
+
+/** Scrive in \param buf il risultato \param result interpretato come \param type.
+ *
+ *   \retval n come snprintf
+ */
+int farmFormat(char *buf, size_t len, farm_type_t type, long result);
+
+
+/* Esecutori esterni (ad esempio nodi remoti) che prendono i task dalla stessa coda */
+
+/** Estrae il prossimo task, aspettando al piu' fino a \param abstime (CLOCK_REALTIME).
+ *
+ *   \retval t task da eseguire
+ *   \retval NULL se il tempo e' scaduto (errno == ETIMEDOUT) o se l'ingresso
+ *           e' chiuso e la coda e' vuota (errno == 0)
+ */
+farm_task_t *farmTake(farm_engine_t *e, const struct timespec *abstime);
+
+/** Consegna alla callback il risultato (t->result) di un task estratto con farmTake.
+ */
+void farmComplete(farm_engine_t *e, size_t executor, farm_task_t *t);
+
+/** Rimette in coda un task estratto con farmTake e non completato.
+ */
+int farmRequeue(farm_engine_t *e, farm_task_t *t);
+
+#endif /* ENGINE_H */
@@ -0,0 +1,273 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "extsort.h"
+
+/**
+ * @file extsort.c
+ * @brief File di implementazione dell'ordinamento esterno dei risultati
+ */
+
+typedef struct es_entry {
+    long   key;
+    char  *name;
+} es_entry_t;
+
+// i run sono file con nome in una directory temporanea, aperti solo durante la
+// fusione che li legge: i descrittori aperti sono al piu' EXTSORT_FANIN + 1
+struct extsort {
+    size_t       mem_limit;
+    size_t       used;
+    es_entry_t  *v;
+    size_t       n;
+    size_t       cap;
+    char        *dir;        // NULL finche' non serve il primo run
+    size_t      *runs;       // numeri dei run ancora da fondere, nell'ordine di creazione
+    size_t       nruns;
+    size_t       runcap;
+    size_t       nextrun;
+};
+
+typedef struct es_reader {
+    FILE    *fp;
+    long     key;
+    char    *name;
+    size_t   namecap;
+} es_reader_t;
+
+
+/* ------------------- funzioni di utilita' -------------------- */
+
+static int Cmp(long ka, const char *na, long kb, const char *nb) {
+    if (ka != kb) return ka < kb ? -1 : 1;
+    return strcmp(na, nb);
+}
+
+static int CmpEntry(const void *a, const void *b) {
+    const es_entry_t *x = a, *y = b;
+    return Cmp(x->key, x->name, y->key, y->name);
+}
+
+static int WriteRec(FILE *fp, long key, const char *name) {
+    uint32_t len = strlen(name);
+    if (fwrite(&key, sizeof(key), 1, fp) != 1 || fwrite(&len, sizeof(len), 1, fp) != 1 ||
+	fwrite(name, 1, len, fp) != len)
+	return -1;
+    return 0;
+}
+
+// ritorna 1 se ha letto un record, 0 a fine run, -1 se errore
+static int ReadRec(es_reader_t *r) {
+    uint32_t len;
+    if (fread(&r->key, sizeof(r->key), 1, r->fp) != 1) return ferror(r->fp) ? -1 : 0;
+    if (fread(&len, sizeof(len), 1, r->fp) != 1) return -1;
+    if (len + 1 > r->namecap) {
+	char *p = realloc(r->name, len + 1);
+	if (!p) return -1;
+	r->name = p;
+	r->namecap = len + 1;
+    }
+    if (fread(r->name, 1, len, r->fp) != len) return -1;
+    r->name[len] = '\0';
+    return 1;
+}
+
+static void RunPath(const extsort_t *s, size_t run, char *path, size_t len) {
+    snprintf(path, len, "%s/run%zu", s->dir, run);
+}
+
+static void RemoveRun(const extsort_t *s, size_t run) {
+    char path[PATH_MAX];
+    RunPath(s, run, path, sizeof(path));
+    unlink(path);
+}
+
+// crea il file del prossimo run (e al primo la directory) e lo apre in scrittura
+static FILE *NewRun(extsort_t *s, size_t *run) {
+    if (!s->dir) {
+	const char *tmp = getenv("TMPDIR");
+	char tmpl[PATH_MAX];
+	snprintf(tmpl, sizeof(tmpl), "%s/farm-sort-XXXXXX", tmp && *tmp ? tmp : P_tmpdir);
+	if (!mkdtemp(tmpl) || !(s->dir = strdup(tmpl))) return NULL;
+    }
+    if (s->nruns == s->runcap) {
+	size_t cap = s->runcap ? s->runcap * 2 : 16;
+	size_t *r = realloc(s->runs, cap * sizeof(size_t));
+	if (!r) return NULL;
+	s->runs = r;
+	s->runcap = cap;
+    }
+    char path[PATH_MAX];
+    *run = s->nextrun++;
+    RunPath(s, *run, path, sizeof(path));
+    return fopen(path, "w");
+}
+
+// chiude il run appena scritto e lo mette in coda a quelli da fondere
+static int CloseRun(extsort_t *s, size_t run, FILE *fp, int err) {
+    if (fclose(fp) == EOF || err) {
+	int myerrno = errno;
+	RemoveRun(s, run);
+	errno = myerrno;
+	return -1;
+    }
+    s->runs[s->nruns++] = run;
+    return 0;
+}
+
+// ordina il blocco in memoria e lo scarica su un nuovo run
+static int Spill(extsort_t *s) {
+    qsort(s->v, s->n, sizeof(es_entry_t), CmpEntry);
+    size_t run;
+    FILE *fp = NewRun(s, &run);
+    if (!fp) return -1;
+    int err = 0;
+    for (size_t i = 0; i < s->n; i++) {
+	if (!err && WriteRec(fp, s->v[i].key, s->v[i].name) == -1) err = 1;
+	free(s->v[i].name);
+    }
+    s->n = 0;
+    s->used = 0;
+    return CloseRun(s, run, fp, err);
+}
+
+static void SiftDown(es_reader_t *r, size_t *heap, size_t n, size_t i) {
+    while (1) {
+	size_t m = i, l = 2 * i + 1, rr = 2 * i + 2;
+	if (l < n && Cmp(r[heap[l]].key, r[heap[l]].name, r[heap[m]].key, r[heap[m]].name) < 0) m = l;
+	if (rr < n && Cmp(r[heap[rr]].key, r[heap[rr]].name, r[heap[m]].key, r[heap[m]].name) < 0) m = rr;
+	if (m == i) return;
+	size_t t = heap[i]; heap[i] = heap[m]; heap[m] = t;
+	i = m;
+    }
+}
+
+typedef struct es_sink {
+    FILE  *fp;
+    int    err;
+} es_sink_t;
+
+// scrive i record fusi su un nuovo run (passate intermedie)
+static void WriteSink(long key, const char *name, void *arg) {
+    es_sink_t *sink = arg;
+    if (!sink->err && WriteRec(sink->fp, key, name) == -1) sink->err = 1;
+}
+
+// fonde i primi k run chiamando F su ogni record in ordine; i run vengono
+// aperti qui e chiusi alla fine, senza cancellarli
+static int Merge(extsort_t *s, size_t k, void (*F)(long, const char *, void *), void *arg) {
+    es_reader_t *r = calloc(k, sizeof(es_reader_t));
+    size_t *heap = calloc(k, sizeof(size_t));
+    int ret = -1;
+    if (!r || !heap) goto end;
+    size_t n = 0;
+    for (size_t i = 0; i < k; i++) {
+	char path[PATH_MAX];
+	RunPath(s, s->runs[i], path, sizeof(path));
+	if (!(r[i].fp = fopen(path, "r"))) goto end;
+	int got = ReadRec(&r[i]);
+	if (got == -1) goto end;
+	if (got == 1) heap[n++] = i;
+    }
+    for (size_t i = n; i-- > 0;) SiftDown(r, heap, n, i);
+    while (n > 0) {
+	es_reader_t *top = &r[heap[0]];
+	F(top->key, top->name, arg);
+	int got = ReadRec(top);
+	if (got == -1) goto end;
+	if (got == 0) heap[0] = heap[--n];
+	SiftDown(r, heap, n, 0);
+    }
+    ret = 0;
+ end:;
+    int myerrno = errno;
+    for (size_t i = 0; r && i < k; i++) {
+	if (r[i].fp) fclose(r[i].fp);
+	free(r[i].name);
+    }
+    errno = myerrno;
+    free(r);
+    free(heap);
+    return ret;
+}
+
+/* ------------------- interfaccia dell'ordinamento ----------- */
+
+extsort_t *extsortInit(size_t mem_limit) {
+    extsort_t *s = calloc(1, sizeof(extsort_t));
+    if (!s) return NULL;
+    s->mem_limit = mem_limit;
+    return s;
+}
+
+int extsortAdd(extsort_t *s, long key, const char *name) {
+    if (!s || !name) {
+	errno = EINVAL;
+	return -1;
+    }
+    size_t sz = sizeof(es_entry_t) + strlen(name) + 1;
+    if (s->n > 0 && s->used + sz > s->mem_limit && Spill(s) == -1) return -1;
+    if (s->n == s->cap) {
+	size_t cap = s->cap ? s->cap * 2 : 1024;
+	es_entry_t *v = realloc(s->v, cap * sizeof(es_entry_t));
+	if (!v) return -1;
+	s->v = v;
+	s->cap = cap;
+    }
+    char *p = strdup(name);
+    if (!p) return -1;
+    s->v[s->n].key = key;
+    s->v[s->n].name = p;
+    s->n += 1;
+    s->used += sz;
+    return 0;
+}
+
+int extsortFinish(extsort_t *s, void (*F)(long key, const char *name, void *arg), void *arg) {
+    if (!s || !F) {
+	errno = EINVAL;
+	return -1;
+    }
+    if (s->nruns == 0) {
+	qsort(s->v, s->n, sizeof(es_entry_t), CmpEntry);
+	for (size_t i = 0; i < s->n; i++) F(s->v[i].key, s->v[i].name, arg);
+	return 0;
+    }
+    if (s->n > 0 && Spill(s) == -1) return -1;
+    // piu' passate se i run sono troppi per essere aperti tutti insieme: ogni
+    // passata fonde i primi EXTSORT_FANIN in un nuovo run in coda agli altri
+    while (s->nruns > EXTSORT_FANIN) {
+	size_t out;
+	es_sink_t sink = { NewRun(s, &out), 0 };
+	if (!sink.fp) return -1;
+	int err = Merge(s, EXTSORT_FANIN, WriteSink, &sink) == -1 || sink.err;
+	int myerrno = errno;
+	if (CloseRun(s, out, sink.fp, err) == -1) {
+	    if (err) errno = myerrno;
+	    return -1;
+	}
+	// i run fusi non servono piu': li cancella solo una passata riuscita
+	for (size_t i = 0; i < EXTSORT_FANIN; i++) RemoveRun(s, s->runs[i]);
+	memmove(s->runs, s->runs + EXTSORT_FANIN, (s->nruns - EXTSORT_FANIN) * sizeof(size_t));
+	s->nruns -= EXTSORT_FANIN;
+    }
+    return Merge(s, s->nruns, F, arg);
+}
+
+void extsortDelete(extsort_t *s) {
+    if (!s) return;
+    for (size_t i = 0; i < s->n; i++) free(s->v[i].name);
+    for (size_t i = 0; i < s->nruns; i++) RemoveRun(s, s->runs[i]);
+    if (s->dir) rmdir(s->dir);
+    free(s->dir);
+    free(s->v);
+    free(s->runs);
+    free(s);
+}
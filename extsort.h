@@ -0,0 +1,46 @@
+#if !defined(EXTSORT_H)
+#define EXTSORT_H
+
+#include <stddef.h>
+
+/** Ordinamento esterno dei risultati (chiave long, poi nome del file).
+ *
+ *  I risultati vengono accumulati in memoria fino a \param mem_limit byte;
+ *  oltre, il blocco viene ordinato e scaricato su un file temporaneo (run) in
+ *  una directory creata sotto $TMPDIR (o P_tmpdir). I run restano chiusi finche'
+ *  non vengono fusi, a gruppi di EXTSORT_FANIN con uno heap: i descrittori
+ *  aperti sono al piu' EXTSORT_FANIN + 1 qualunque sia il numero dei run.
+ */
+
+#if !defined(EXTSORT_FANIN)
+#define EXTSORT_FANIN 64
+#endif
+
+typedef struct extsort extsort_t;
+
+
+/** Alloca un ordinamento che usa al piu' \param mem_limit byte in memoria.
+ *
+ *   \retval NULL se errore (errno settato)
+ */
+extsort_t *extsortInit(size_t mem_limit);
+
+/** Aggiunge un risultato.
+ *
+ *   \retval 0 se successo
+ *   \retval -1 se errore (errno settato opportunamente)
+ */
+int extsortAdd(extsort_t *s, long key, const char *name);
+
+/** Chiama \param F su tutti i risultati in ordine crescente.
+ *
+ *   \retval 0 se successo
+ *   \retval -1 se errore (errno settato opportunamente)
+ */
+int extsortFinish(extsort_t *s, void (*F)(long key, const char *name, void *arg), void *arg);
+
+/** Libera la memoria e cancella i file temporanei e la loro directory.
+ */
+void extsortDelete(extsort_t *s);
+
+#endif /* EXTSORT_H */
@@ -19,6 +19,7 @@
 #include <assert.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <getopt.h>
 #include <semaphore.h>
 #include <signal.h>
 #include <stdarg.h>
@@ -29,45 +30,141 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/wait.h>
-#include <sys/un.h>
 #include <unistd.h>
 
 /*----- Includes Personali -----*/
 #include "util.h"
-#include "boundedqueue.h"
+#include "codec.h"
+#include "engine.h"
+#include "extsort.h"
+#include "journal.h"
+#include "membudget.h"
+#include "namelist.h"
+#include "netproto.h"
+#include "prioqueue.h"
+#include "resultring.h"
+#include "throttle.h"
 
 /*----- DEFINES -----*/
-#define EOS (void *)0x1
 #define NAME_MAX 256
 #define N_THREADS 4L
 #define Q_LEN 8L
 #define DELAY 0L
 #define RECONNECT 50000
+#define NODE_SLOTS 16      // nodi remoti connessi contemporaneamente al coordinatore
+#define NODE_POLL_MS 100   // ogni quanto un sender controlla se il suo nodo e' caduto
+#define NODE_RETRIES 100   // tentativi di connessione di un nodo (ogni RECONNECT us)
+#define NAP_STEP_MS 10     // con -t il master controlla sig_term almeno ogni NAP_STEP_MS
+#define REORDER_WINDOW 1024L   // con -o input: task assegnati e non ancora stampati
+#define SORT_MEM (64L << 20)   // con -o result: byte in memoria prima di scaricare un run su file (-S)
+
+#define PRIO_CLASSES 3    // 0 urgente, 1 normale, 2 bulk
+#define PRIO_DEFAULT 1
+#define PRIO_RULES 32     // regole -p al massimo
+
+#define ORDER_NONE 0
+#define ORDER_INPUT 1
+#define ORDER_RESULT 2
 
-#define UNIX_PATH_MAX 108
-#define SOCKNAME "./sck_y"
 #define SHMNAME "/shmem-prodcons"
 
 typedef struct shmsegment
 {
 	sem_t semS;
 	sem_t semC;
+	sem_t credit;      // con -o input: posti liberi nella finestra di riordino del Collector
+	ring_set_t *rings; // NULL se i risultati passano dal socket
+	volatile sig_atomic_t cancelled; // 1 dopo un segnale di terminazione: niente stampa finale
 } shmsegment_t;
 
+// il task del motore e' il primo campo: la callback risale a f_struct_t con un cast
 typedef struct f_struct
 {
-	char *filename;
-	size_t filesize;
+	farm_task_t t; // t.done: il file e' gia' nel journal, il Worker non lo ricalcola
+	struct timespec mtime;
 } f_struct_t;
 
+typedef struct th_struct th_struct_t;
+
 typedef struct th_struct
 {
 	int fd_skt;
 	sem_t *semS;
 	sem_t *semC;
-	BQueue_t *q;
+	ring_set_t *rings;
+	farm_engine_t *engine;
+	void (*emit)(th_struct_t *th, size_t id, const res_record_t *rec);
 } th_struct_t;
 
+typedef struct coord_struct coord_struct_t;
+
+typedef struct node_slot
+{
+	size_t id;
+	coord_struct_t *coord;
+	int busy;
+	int fd;
+	int dead;             // connessione caduta: i task in volo tornano nella coda
+	size_t window;        // task in volo al massimo sul nodo
+	f_struct_t **inflight;
+	pthread_mutex_t m;
+	sem_t win;
+	pthread_t sender;
+} node_slot_t;
+
+typedef struct coord_struct
+{
+	int fd_listen;
+	th_struct_t *th;
+	size_t ring_base;     // i ring dei nodi seguono quelli dei Worker locali
+	node_slot_t slot[NODE_SLOTS];
+	size_t active;
+	pthread_mutex_t m;
+	pthread_cond_t c;
+} coord_struct_t;
+
+// con i Worker tutti occupati la classe 0 ha 8 estrazioni ogni 13, la 2 almeno una
+static const unsigned prio_weights[PRIO_CLASSES] = {8, 4, 1};
+
+typedef struct prio_rule
+{
+	const char *dir;
+	size_t len;
+	unsigned cls;
+} prio_rule_t;
+
+typedef struct m_struct
+{
+	th_struct_t *th;
+	journal_index_t *jindex;
+	long delay;
+	uint64_t next_id;
+	sem_t *credit; // NULL se l'ordine di uscita e' libero
+	prio_rule_t *rules;
+	size_t nrules;
+	farm_type_t type; // tipo degli elementi dei file (-T, --be)
+	int be;
+} m_struct_t;
+
+typedef struct sig_struct
+{
+	sigset_t set;
+	const char *ctl;  // file di controllo del limitatore, riletto con SIGUSR2
+	throttle_t *thr;
+	farm_engine_t *engine;  // annullato alla terminazione
+	coord_struct_t *coord;  // NULL senza -L
+	shmsegment_t *shm;
+	struct timespec when;   // arrivo del segnale di terminazione
+} sig_struct_t;
+
+typedef struct coll_struct
+{
+	const char *journal; // NULL se non e' stato passato -J
+	int order;           // ORDER_NONE, ORDER_INPUT o ORDER_RESULT
+	farm_type_t type;    // con -o result: tipo con cui confrontare i risultati
+	long sort_mem;       // con -o result: memoria dell'ordinamento esterno
+} coll_struct_t;
+
 volatile sig_atomic_t sig_term = 0;
 
 /*----- Funzioni -----*/
@@ -83,8 +180,26 @@ format_cmd(const char *progname)
 	fprintf(stderr, "Il programma va lanciato con il seguente comando:\n");
 	fprintf(stderr, "\n\t./%s [OPTION]... [FILES LIST]...\n\n", progname);
 	fprintf(stderr, "-n\n    numero di thread (default 4)\n");
-	fprintf(stderr, "-q\n    lunghezza delal coda concorrente (default 8)\n");
+	fprintf(stderr, "-q\n    lunghezza delal coda concorrente, in tutto per le classi di priorita' (default 8)\n");
 	fprintf(stderr, "-t\n    tempo in ms tra l'invio delle richieste ai thread Worker (default 0)\n");
+	fprintf(stderr, "-r\n    i risultati passano al Collector tramite ring in memoria condivisa invece del socket\n");
+	fprintf(stderr, "-J\n    journal dei file completati: i file gia' presenti (stessa dimensione e mtime) non vengono ricalcolati\n");
+	fprintf(stderr, "-f\n    file con la lista dei file da elaborare, uno per riga (\"-\" per lo standard input)\n");
+	fprintf(stderr, "-0\n    i nomi nella lista di -f sono separati da '\\0' invece che da '\\n'\n");
+	fprintf(stderr, "-o input|result\n    stampa i risultati nell'ordine dei file in input oppure ordinati per valore\n");
+	fprintf(stderr, "-S\n    con -o result: byte di risultati tenuti in memoria prima di scaricarli su un file temporaneo (default 64MB)\n");
+	fprintf(stderr, "-T i64|i32|u64|f64\n    tipo degli elementi dei file (default i64; il formato compatto e' solo i64)\n");
+	fprintf(stderr, "--be\n    gli elementi dei file sono big-endian\n");
+	fprintf(stderr, "-b\n    byte al secondo letti dai Worker, in totale (default nessun limite)\n");
+	fprintf(stderr, "-B\n    burst in byte concesso oltre il limite di -b (default un secondo di -b)\n");
+	fprintf(stderr, "-F\n    file al secondo elaborati dai Worker, in totale (default nessun limite)\n");
+	fprintf(stderr, "-w\n    byte di un file mappati al massimo da un Worker; le pagine elaborate vengono rilasciate (default 16MB)\n");
+	fprintf(stderr, "-m\n    byte mappati al massimo da tutti i Worker insieme (default nessun limite)\n");
+	fprintf(stderr, "-C\n    file di controllo \"byte/s [burst [file/s]]\" riletto alla ricezione di SIGUSR2\n");
+	fprintf(stderr, "-p dir=classe\n    i file sotto dir vanno nella classe di priorita' indicata (0 urgente, 1 normale, 2 bulk; default 1)\n");
+	fprintf(stderr, "-P\n    le righe della lista di -f sono nella forma \"classe<TAB>nome\"\n");
+	fprintf(stderr, "-L, --listen [host:]porta\n    coordinatore: accetta nodi Worker remoti (con -n 0 calcolano solo i nodi)\n");
+	fprintf(stderr, "--worker-node host:porta\n    nodo Worker: esegue -n thread con i task ricevuti dal coordinatore (tipo e ordine dei byte li decide il coordinatore)\n");
 	fflush(stderr);
 }
 
@@ -136,9 +251,29 @@ check(int test, const char *message, ...)
 /**
  * @brief	Il corpo del processo Collector
  *
- * @param	sa indirizzo della connessione socket AF_UNIX
+ * @param	fd_c estremo del socketpair creato prima della fork (-1 se i risultati passano dai ring)
+ * @param	shmptr segmento condiviso con il processo master
+ * @param	opts opzioni del Collector
+ */
+static void Collector(int fd_c, shmsegment_t *shmptr, const coll_struct_t *opts);
+
+/**
+ * @brief	Controlla che il file sia regolare e ne restituisce dimensione e data di ultima modifica
+ *
+ * @retval	1 se è un file regolare, 0 se non lo è, -1 in caso di errore (errno settato)
  */
-static void Collector(struct sockaddr_un sa, shmsegment_t *shmptr);
+static int
+file_info(const char *name, size_t *size, struct timespec *mtime)
+{
+	struct stat statbuf;
+	if (stat(name, &statbuf) == -1)
+		return -1;
+	if (!S_ISREG(statbuf.st_mode))
+		return 0;
+	*size = statbuf.st_size;
+	*mtime = statbuf.st_mtim;
+	return 1;
+}
 
 /**
  * @brief	Aspetta la terminazione del processo collector e stampa lo status con cui termina il processo
@@ -167,18 +302,88 @@ collector_exit_status(pid_t pid)
 }
 
 /**
- * @brief	Start routine dei thread Worker
+ * @brief	Controlla il file \p name e, se e' regolare, lo inserisce nella coda dei Worker
+ *
+ * @param	m stato del master
+ * @param	name nome del file
+ * @param	cls classe di priorita', -1 per usare le regole di -p
+ */
+static void dispatch_file(m_struct_t *m, const char *name, int cls);
+
+/**
+ * @brief	Aspetta \p ms millisecondi (il ritardo di -t), interrompendosi entro
+ * NAP_STEP_MS dall'arrivo di un segnale di terminazione
+ */
+static void nap(long ms);
+
+/**
+ * @brief	Stampa su stderr l'attesa in coda dei task di ogni classe di priorita'
+ */
+static void
+print_prio_stats(farm_engine_t *engine)
+{
+	for (size_t c = 0; c < PRIO_CLASSES; c++)
+	{
+		pq_stats_t st;
+		farmStats(engine, c, &st);
+		if (st.count == 0)
+			continue;
+		// percentile approssimato per eccesso alla potenza di 2 di microsecondi
+		uint64_t seen = 0, p99 = 0;
+		for (size_t k = 0; k < PQ_HIST && seen * 100 < st.count * 99; k++)
+		{
+			seen += st.hist[k];
+			p99 = k == 0 ? 1 : 1ULL << k;
+		}
+		fprintf(stderr, "Classe %zu: %lu task, attesa in coda media %.3f ms, p99 <= %.3f ms, max %.3f ms\n",
+				c, (unsigned long)st.count, st.total_ns / 1e6 / st.count, p99 / 1e3, st.max_ns / 1e6);
+	}
+}
+
+/**
+ * @brief	Callback dei risultati del motore: costruisce il record per il Collector,
+ * lo invia con th->emit sul ring (o dal socket) \p worker e libera il task
+ */
+static void task_result(size_t worker, farm_task_t *t, void *arg);
+
+/**
+ * @brief	Crea il motore dei Worker, uscendo con un messaggio se non e' possibile
+ */
+static farm_engine_t *new_engine(const farm_opts_t *o);
+
+/**
+ * @brief	Invia il record del risultato al Collector sul socket, sincronizzandosi con i semafori
  */
-static void *Worker(void *arg);
+static void emit_socket(th_struct_t *th, size_t id, const res_record_t *rec);
 
 /**
- * @brief	Mappa un file di interi long
+ * @brief	Invia il risultato al Collector come record nel ring del Worker \p id
+ */
+static void emit_ring(th_struct_t *th, size_t id, const res_record_t *rec);
+
+/**
+ * @brief	Callback dei risultati del nodo Worker: li invia al coordinatore sulla connessione TCP
+ */
+static void node_result(size_t worker, farm_task_t *t, void *arg);
+
+/**
+ * @brief	Start routine del thread che accetta le connessioni dei nodi Worker remoti
+ */
+static void *Acceptor(void *arg);
+
+/**
+ * @brief	Chiude le connessioni dei nodi remoti: i loro task in volo tornano al
+ * motore, che dopo farmCancel li consegna annullati
+ */
+static void coord_cancel(coord_struct_t *coord);
+
+/**
+ * @brief	Routine del processo lanciato con --worker-node
  *
- * @param	file_name nome del file
- * @param	contents_ptr puntatore che punta alla locazione di memoria mappata
- * @param	size dimensione della memoria in byte da mappare
+ * @param	addr indirizzo del coordinatore
+ * @param	o opzioni del motore dei Worker (thread, coda, finestra, limiti)
  */
-void mmap_file(const char *file_name, long **contents_ptr, size_t size);
+static int run_node(const char *addr, farm_opts_t *o);
 
 /*----- GESTORE DEI SEGNALI -----*/
 /**
@@ -186,13 +391,13 @@ void mmap_file(const char *file_name, long **contents_ptr, size_t size);
  * Si mette in attesa finchè non arrivano alcuni segnali e all'arrivo
  * esegue l' azione prevista
  *
- * @param	sigptr set da gestisce
+ * @param	sigptr set da gestisce, con il file di controllo del limitatore
  */
 void *Signal_Handler(void *arg)
 {
 
-	sigset_t *sigptr = (sigset_t *)arg;
-	sigset_t sigset = *sigptr;
+	sig_struct_t *sigptr = (sig_struct_t *)arg;
+	sigset_t sigset = sigptr->set;
 
 	int n;
 	int signal;
@@ -209,7 +414,25 @@ void *Signal_Handler(void *arg)
 
 		if ((signal == SIGINT) || (signal == SIGQUIT) || (signal == SIGTERM) || (signal == SIGHUP))
 		{
+			// il master smette di inserire, i Worker lasciano il file al pezzo successivo,
+			// il master fermo su -t o sul credito di -o input si risveglia
+			clock_gettime(CLOCK_MONOTONIC, &sigptr->when);
 			sig_term = 1;
+			sigptr->shm->cancelled = 1;
+			farmCancel(sigptr->engine);
+			if (sigptr->coord)
+				coord_cancel(sigptr->coord);
+			V(&sigptr->shm->credit);
+		}
+
+		if (signal == SIGUSR2)
+		{
+			if (sigptr->ctl == NULL || sigptr->thr == NULL)
+				fprintf(stderr, "SIGUSR2 ignorato: serve -C con almeno uno tra -b e -F\n");
+			else if (reloadThrottle(sigptr->thr, sigptr->ctl) == -1)
+				fprintf(stderr, "Lettura di %s ha fallito: %s\n", sigptr->ctl, strerror(errno));
+			else
+				DBG("Limiti riletti da %s\n", sigptr->ctl);
 		}
 
 		if (signal == SIGUSR1)
@@ -235,9 +458,28 @@ int main(int argc, char *argv[])
 	long n = N_THREADS;
 	long q_len = Q_LEN;
 	long delay = DELAY;
+	int use_rings = 0;
+	coll_struct_t coll = {NULL, ORDER_NONE, FARM_I64, SORT_MEM};
+	int big_endian = 0;
+	const char *listen_addr = NULL;
+	const char *node_addr = NULL;
+	long bps = 0, burst = 0, fps = 0;
+	long window = MAP_WINDOW, mem = 0;
+	const char *ctl = NULL;
+	const char *list = NULL;
+	char list_sep = '\n';
+	int prio_column = 0;
+	prio_rule_t rules[PRIO_RULES];
+	size_t nrules = 0;
+
+	static struct option long_opts[] = {
+		{"listen", required_argument, NULL, 'L'},
+		{"worker-node", required_argument, NULL, 'W'},
+		{"be", no_argument, NULL, 'E'},
+		{NULL, 0, NULL, 0}};
 
 	int opt;
-	while ((opt = getopt(argc, argv, ":n:q:t:")) != -1)
+	while ((opt = getopt_long(argc, argv, ":n:q:t:rJ:L:b:B:F:C:f:0o:S:w:m:p:PT:", long_opts, NULL)) != -1)
 	{
 		switch (opt)
 		{
@@ -253,6 +495,106 @@ int main(int argc, char *argv[])
 			DBG("Delay: %s\n", optarg);
 			check_param(optarg, &delay);
 			break;
+		case 'r':
+			DBG("Trasporto dei risultati: ring in memoria condivisa\n", NULL);
+			use_rings = 1;
+			break;
+		case 'J':
+			DBG("Journal: %s\n", optarg);
+			coll.journal = optarg;
+			break;
+		case 'o':
+			DBG("Ordine di uscita: %s\n", optarg);
+			if (strcmp(optarg, "input") == 0)
+				coll.order = ORDER_INPUT;
+			else if (strcmp(optarg, "result") == 0)
+				coll.order = ORDER_RESULT;
+			else
+			{
+				fprintf(stderr, "-o accetta solo input o result\n");
+				return 1;
+			}
+			break;
+		case 'S':
+			DBG("Memoria dell'ordinamento: %s\n", optarg);
+			check_param(optarg, &coll.sort_mem);
+			break;
+		case 'T':
+		{
+			DBG("Tipo degli elementi: %s\n", optarg);
+			int type = farmTypeByName(optarg);
+			if (type == -1)
+			{
+				fprintf(stderr, "-T accetta solo i64, i32, u64 o f64\n");
+				return 1;
+			}
+			coll.type = type;
+			break;
+		}
+		case 'E':
+			big_endian = 1;
+			break;
+		case 'f':
+			DBG("Lista dei file: %s\n", optarg);
+			list = optarg;
+			break;
+		case '0':
+			list_sep = '\0';
+			break;
+		case 'P':
+			prio_column = 1;
+			break;
+		case 'p':
+		{
+			DBG("Regola di priorita': %s\n", optarg);
+			char *eq = strrchr(optarg, '=');
+			if (eq == NULL || eq == optarg || nrules == PRIO_RULES)
+			{
+				fprintf(stderr, "-p vuole dir=classe (al massimo %d regole)\n", PRIO_RULES);
+				return 1;
+			}
+			long cls;
+			check_param(eq + 1, &cls);
+			check(cls < 0 || cls >= PRIO_CLASSES, "La classe di -p deve essere tra 0 e %d", PRIO_CLASSES - 1);
+			*eq = '\0';
+			size_t len = strlen(optarg);
+			while (len > 1 && optarg[len - 1] == '/')
+				optarg[--len] = '\0';
+			rules[nrules++] = (prio_rule_t){optarg, len, cls};
+			break;
+		}
+		case 'b':
+			DBG("Byte al secondo: %s\n", optarg);
+			check_param(optarg, &bps);
+			break;
+		case 'B':
+			DBG("Burst: %s\n", optarg);
+			check_param(optarg, &burst);
+			break;
+		case 'F':
+			DBG("File al secondo: %s\n", optarg);
+			check_param(optarg, &fps);
+			break;
+		case 'w':
+			DBG("Finestra mappata: %s\n", optarg);
+			check_param(optarg, &window);
+			break;
+		case 'm':
+			DBG("Budget della memoria mappata: %s\n", optarg);
+			check_param(optarg, &mem);
+			break;
+		case 'C':
+			DBG("File di controllo del limitatore: %s\n", optarg);
+			ctl = optarg;
+			break;
+		case 'L':
+			DBG("Coordinatore in ascolto su %s\n", optarg);
+			listen_addr = optarg;
+			break;
+		case 'W':
+			DBG("Nodo Worker del coordinatore %s\n", optarg);
+			node_addr = optarg;
+			break;
 		case ':':
 			fprintf(stderr, "opzione %c è stata passata senza un valore\n", opt);
 			return 1;
@@ -263,6 +605,40 @@ int main(int argc, char *argv[])
 		}
 	}
 
+	check(bps < 0 || burst < 0 || fps < 0, "I limiti di -b, -B e -F non possono essere negativi");
+	throttle_t *thr = NULL;
+	if (bps > 0 || fps > 0 || ctl)
+	{
+		errno = 0;
+		thr = initThrottle(bps, burst, fps);
+		check(thr == NULL, "initThrottle ha fallito: %s", strerror(errno));
+		if (ctl && reloadThrottle(thr, ctl) == -1)
+			fprintf(stderr, "Lettura di %s ha fallito: %s\n", ctl, strerror(errno));
+	}
+
+	check(q_len <= 0, "La lunghezza della coda deve essere positiva");
+	check(coll.sort_mem <= 0, "La memoria dell'ordinamento di -S deve essere positiva");
+	check(window <= 0 || mem < 0, "La finestra di -w deve essere positiva e il budget di -m non negativo");
+	membudget_t *budget = NULL;
+	if (mem > 0)
+	{
+		errno = 0;
+		budget = initBudget(mem);
+		check(budget == NULL, "initBudget ha fallito: %s", strerror(errno));
+	}
+
+	farm_opts_t fo = {n, q_len, PRIO_CLASSES, prio_weights, window, thr, budget, coll.type, big_endian, NULL, NULL};
+	if (node_addr)
+	{
+		check(n <= 0, "Il numero di thread deve essere positivo");
+		if (ctl)
+			fprintf(stderr, "Il nodo legge %s solo all'avvio: SIGUSR2 ricarica i limiti solo sul coordinatore\n", ctl);
+		int r = run_node(node_addr, &fo);
+		deleteThrottle(thr);
+		deleteBudget(budget);
+		return r;
+	}
+
 	int err;
 	/*----- SIGNALS SETUP -----*/
 	struct sigaction s;
@@ -273,45 +649,69 @@ int main(int argc, char *argv[])
 	err = sigaction(SIGPIPE, &s, NULL);
 	check(err == -1, "Errore nell'ignorare sengale SIGPIPE: %s", strerror(errno));
 
-	sigset_t set;
+	sig_struct_t sig_struct;
+	sigset_t *setp = &sig_struct.set;
+	sig_struct.ctl = ctl;
+	sig_struct.thr = thr;
 	pthread_t sig_handler;
 
 	errno = 0;
-	err = sigemptyset(&set);
+	err = sigemptyset(setp);
 	check(err == -1, "Funzione sigemptyset ha fallito: %s", strerror(errno));
 	
 	errno = 0;
-	err = sigaddset(&set, SIGINT);
+	err = sigaddset(setp, SIGINT);
 	check(err == -1, "Funzione sigaddset ha fallito: %s", strerror(errno));
 	errno = 0;
-	err = sigaddset(&set, SIGQUIT);
+	err = sigaddset(setp, SIGQUIT);
 	check(err == -1, "Funzione sigaddset ha fallito: %s", strerror(errno));
 	errno = 0;
-	err = sigaddset(&set, SIGTERM);
+	err = sigaddset(setp, SIGTERM);
 	check(err == -1, "Funzione sigaddset ha fallito: %s", strerror(errno));
 	errno = 0;
-	err = sigaddset(&set, SIGHUP);
+	err = sigaddset(setp, SIGHUP);
 	check(err == -1, "Funzione sigaddset ha fallito: %s", strerror(errno));
 	errno = 0;
-	err = sigaddset(&set, SIGUSR1);
+	err = sigaddset(setp, SIGUSR1);
+	check(err == -1, "Funzione sigaddset ha fallito: %s", strerror(errno));
+	errno = 0;
+	err = sigaddset(setp, SIGUSR2);
 	check(err == -1, "Funzione sigaddset ha fallito: %s", strerror(errno));
 
-	err = pthread_sigmask(SIG_SETMASK, &set, NULL);
+	// il thread dei segnali parte quando motore e coordinatore esistono: fino ad
+	// allora i segnali restano pendenti. La maschera la eredita anche il Collector
+	err = pthread_sigmask(SIG_SETMASK, setp, NULL);
 	check(err != 0, "Funzione pthread_sigmask ha fallito: %s", strerror(err));
 
-	err = pthread_create(&sig_handler, NULL, Signal_Handler, &set);
-	check(err != 0, "pthread_create sig_handler ha fallito: %s", strerror(err));
-
 	/*----- SOCKET SETUP -----*/
 
-	int fd_skt;
-	struct sockaddr_un sa;
-	strncpy(sa.sun_path, SOCKNAME, UNIX_PATH_MAX);
-	sa.sun_family = AF_UNIX;
+	check(n < 0 || (n == 0 && !listen_addr), "Il numero di thread deve essere positivo");
+
+	// il canale verso il Collector esiste gia' prima della fork: niente bind su un
+	// file del filesystem, niente attesa attiva della connect e nessun socket orfano
+	int fd_skt = -1;
+	int sv[2] = {-1, -1};
+	if (!use_rings)
+	{
+		errno = 0;
+		err = socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+		check(err == -1, "socketpair ha fallito: %s", strerror(errno));
+		fd_skt = sv[0];
+	}
 
+	// i ring (uno per Worker) stanno nello stesso segmento, subito dopo i semafori;
+	// ogni slot dei nodi remoti ne ha due: uno per il receiver e uno per il sender
+	size_t nrings = n + (listen_addr ? 2 * NODE_SLOTS : 0);
+	size_t shmsize = sizeof(shmsegment_t) + (use_rings ? ringSetSize(nrings) : 0);
 	errno = 0;
-	shmsegment_t *shmptr = mmap(0, sizeof(shmsegment_t), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	shmsegment_t *shmptr = mmap(0, shmsize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
 	check(shmptr == MAP_FAILED,"shmsegment_t mmap ha fallito: %s",strerror(errno));
+	shmptr->rings = NULL;
+	if (use_rings)
+	{
+		shmptr->rings = (ring_set_t *)(shmptr + 1);
+		initRingSet(shmptr->rings, nrings);
+	}
 
 	errno = 0;
 	err = sem_init(&shmptr->semS, 1, 0);
@@ -319,24 +719,31 @@ int main(int argc, char *argv[])
 	errno = 0;
 	err = sem_init(&shmptr->semC, 1, 0);
 	check(err == -1,"sem_init ha fallito: %s",strerror(errno));
+	errno = 0;
+	err = sem_init(&shmptr->credit, 1, REORDER_WINDOW);
+	check(err == -1,"sem_init ha fallito: %s",strerror(errno));
 
-	pid_t collector_pid = fork();
-	if (collector_pid == 0)
+	// l'indice va letto prima della fork: il Collector riaprira' lo stesso file in append
+	journal_index_t *jindex = NULL;
+	if (coll.journal)
 	{
-		Collector(sa,shmptr);
-		exit(EXIT_SUCCESS);
+		errno = 0;
+		jindex = journalLoad(coll.journal);
+		check(jindex == NULL, "Lettura del journal %s ha fallito: %s", coll.journal, strerror(errno));
 	}
 
-	/*----- CLIENT SETUP -----*/
-
-	fd_skt = socket(AF_UNIX, SOCK_STREAM, 0);
-	while (connect(fd_skt, (struct sockaddr *)&sa, sizeof(sa)) == -1)
+	pid_t collector_pid = fork();
+	if (collector_pid == 0)
 	{
-		if (errno == ENOENT)
-			usleep(RECONNECT); // Aspetta 50ms per riprovare la connessione
-		else
-			exit(EXIT_FAILURE);
+		journalFreeIndex(jindex);
+		if (!use_rings)
+			close(sv[0]);
+		Collector(sv[1], shmptr, &coll);
+		exit(EXIT_SUCCESS);
 	}
+	check(collector_pid == -1, "fork del Collector ha fallito: %s", strerror(errno));
+	if (!use_rings)
+		close(sv[1]);
 
 	/*----- MASTER ROUTINE -----*/
 
@@ -346,43 +753,87 @@ int main(int argc, char *argv[])
 	th_struct->fd_skt = fd_skt;
 	th_struct->semS = &shmptr->semS;
 	th_struct->semC = &shmptr->semC;
-
-	errno = 0;
-	BQueue_t *q = initBQueue(q_len);
-	check(q == NULL, "initBQueue ha fallito: %s", strerror(errno));
-	th_struct->q = q;
-
-	pthread_t th[n];
-	for (size_t i = 0; i < n; i++)
+	th_struct->rings = shmptr->rings;
+	th_struct->emit = use_rings ? emit_ring : emit_socket;
+
+	// il motore avvia i Worker con i task: un'esecuzione con pochi file non
+	// paga la creazione di thread che non riceverebbero lavoro
+	fo.cb = task_result;
+	fo.arg = th_struct;
+	th_struct->engine = new_engine(&fo);
+
+	coord_struct_t *coord = NULL;
+	pthread_t acceptor;
+	if (listen_addr)
 	{
-		err = pthread_create(&th[i], NULL, Worker, th_struct);
-		check(err != 0, "pthread_create ha fallito (Worker n.%ld): %s", i, strerror(err));
+		coord = calloc(1, sizeof(coord_struct_t));
+		check(coord == NULL, "malloc del coordinatore ha fallito");
+		errno = 0;
+		coord->fd_listen = netListen(listen_addr);
+		check(coord->fd_listen == -1, "Ascolto su %s ha fallito: %s", listen_addr, strerror(errno));
+		coord->th = th_struct;
+		coord->ring_base = n;
+		for (size_t i = 0; i < NODE_SLOTS; i++)
+		{
+			coord->slot[i].id = i;
+			coord->slot[i].coord = coord;
+		}
+		err = pthread_mutex_init(&coord->m, NULL);
+		check(err != 0, "pthread_mutex_init ha fallito: %s", strerror(err));
+		err = pthread_cond_init(&coord->c, NULL);
+		check(err != 0, "pthread_cond_init ha fallito: %s", strerror(err));
+		err = pthread_create(&acceptor, NULL, Acceptor, coord);
+		check(err != 0, "pthread_create Acceptor ha fallito: %s", strerror(err));
 	}
 
+	sig_struct.engine = th_struct->engine;
+	sig_struct.coord = coord;
+	sig_struct.shm = shmptr;
+	err = pthread_create(&sig_handler, NULL, Signal_Handler, &sig_struct);
+	check(err != 0, "pthread_create sig_handler ha fallito: %s", strerror(err));
+
 	/*----- TEST DEI FILE -----*/
 
+	m_struct_t m = {th_struct, jindex, delay, 0, coll.order == ORDER_INPUT ? &shmptr->credit : NULL, rules, nrules, coll.type, big_endian};
 	for (size_t i = optind; i < argc && sig_term != 1; i++)
+		dispatch_file(&m, argv[i], -1);
+
+	// la lista viene letta un blocco alla volta: i Worker partono appena arriva il primo nome
+	if (list && sig_term != 1)
 	{
-		size_t filesize;
 		errno = 0;
-		if (isRegular(argv[i], &filesize) != 1)
+		nlist_t *fl = nlistOpen(list, list_sep);
+		if (fl == NULL)
+			fprintf(stderr, "Apertura della lista %s ha fallito: %s\n", list, strerror(errno));
+		nlistSetCancel(fl, &sig_term);
+		const char *name;
+		while (fl && sig_term != 1 && (name = nlistNext(fl)) != NULL)
 		{
-			if (errno == 0)
+			int cls = -1;
+			if (prio_column)
 			{
-				fprintf(stderr, "%s non e' un file regolare\n", argv[i]);
-				continue;
+				char *end;
+				unsigned long c = strtoul(name, &end, 10);
+				if (end == name || *end != '\t' || c >= PRIO_CLASSES)
+				{
+					fprintf(stderr, "Riga della lista senza una classe valida: %s\n", name);
+					continue;
+				}
+				cls = c;
+				name = end + 1;
 			}
-			perror("isRegular");
-			continue;
+			dispatch_file(&m, name, cls);
 		}
-		f_struct_t *file = malloc(sizeof(f_struct_t));
-		file->filename = strdup(argv[i]);
-		file->filesize = filesize;
-
-		usleep(delay * 1000);
-		push(q, file);
+		if (fl && errno != 0 && sig_term != 1)
+			fprintf(stderr, "Lettura della lista %s ha fallito: %s\n", list, strerror(errno));
+		nlistClose(fl);
 	}
-	push(q, EOS);
+	// l'ingresso si chiude solo quando tutti i task sono completati:
+	// quelli di un nodo remoto caduto possono ancora tornare nella coda
+	farmDrain(th_struct->engine);
+	farmClose(th_struct->engine);
+	if (nrules > 0 || prio_column)
+		print_prio_stats(th_struct->engine);
 
 	/*----- TERMINATION ROUTINE -----*/
 
@@ -398,131 +849,760 @@ int main(int argc, char *argv[])
 		check(err != 0, "pthread_join di sig_handler ha fallito: %s\n", strerror(err));
 	}
 
-	for (size_t i = 0; i < n; i++)
+	if (coord)
 	{
-		err = pthread_join(th[i], NULL);
-		check(err != 0, "pthread_join ha fallito (Worker n.%ld): %s\n", i, strerror(err));
+		shutdown(coord->fd_listen, SHUT_RDWR);
+		err = pthread_join(acceptor, NULL);
+		check(err != 0, "pthread_join di Acceptor ha fallito: %s\n", strerror(err));
+		LOCK(&coord->m);
+		while (coord->active > 0)
+			WAIT(&coord->c, &coord->m);
+		UNLOCK(&coord->m);
+		close(coord->fd_listen);
+		if (th_struct->rings)
+			for (size_t i = coord->ring_base; i < nrings; i++)
+				ringClose(th_struct->rings, i);
+		pthread_mutex_destroy(&coord->m);
+		pthread_cond_destroy(&coord->c);
+		free(coord);
 	}
 
-	deleteBQueue(th_struct->q, NULL);
+	// i nodi hanno finito di usare il motore: si aspettano i Worker locali,
+	// poi si chiudono i loro ring (anche quelli dei Worker mai partiti)
+	deleteFarm(th_struct->engine);
+	if (th_struct->rings)
+		for (size_t i = 0; i < n; i++)
+			ringClose(th_struct->rings, i);
 	free(th_struct);
+	deleteThrottle(thr);
+	deleteBudget(budget);
+	journalFreeIndex(jindex);
 
-	close(fd_skt);
-	V(&shmptr->semC);
+	if (!use_rings)
+	{
+		close(fd_skt);
+		V(&shmptr->semC);
+	}
 	collector_exit_status(collector_pid);
 
 	errno = 0;
-	err = munmap(shmptr,sizeof(shmsegment_t));
+	err = munmap(shmptr, shmsize);
 	check(err == -1, "munmap di shmptr ha fallito: %s\n", strerror(errno));
 
-	errno = 0;
-	err = unlink(SOCKNAME);
-	check(err == -1, "unlink del socket %s ha fallito: %s\n", SOCKNAME, strerror(errno));
-
+	if (sig_term == 1)
+	{
+		struct timespec now;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		fprintf(stderr, "Terminazione completata %.1f ms dopo il segnale\n",
+				(now.tv_sec - sig_struct.when.tv_sec) * 1e3 + (now.tv_nsec - sig_struct.when.tv_nsec) / 1e6);
+	}
 	return 0;
 }
 
 /*----- COLLECTOR -----*/
+
+#define OUT_BUFSIZE 65536
+
+typedef struct out_buf
+{
+	size_t len;
+	char data[OUT_BUFSIZE];
+} out_buf_t;
+
 static void
-Collector(struct sockaddr_un sa, shmsegment_t *shmptr)
+out_flush(out_buf_t *out)
 {
-	int fd_skt, fd_c;
-	DBG("Collector is up\n", NULL);
+	size_t off = 0;
+	while (off < out->len)
+	{
+		errno = 0;
+		ssize_t r = write(STDOUT_FILENO, out->data + off, out->len - off);
+		check(r == -1, "Funzione write nel Collector ha fallito: %s", strerror(errno));
+		off += r;
+	}
+	out->len = 0;
+}
 
-	/*----- SERVER SETUP -----*/
-	int r;
+static void
+out_line(out_buf_t *out, farm_type_t type, long result, const char *filename)
+{
+	char num[32];
+	farmFormat(num, sizeof(num), type, result);
+	int len = snprintf(NULL, 0, "%s %s\n", num, filename);
+	if (out->len + len + 1 > OUT_BUFSIZE)
+		out_flush(out);
+	snprintf(out->data + out->len, OUT_BUFSIZE - out->len, "%s %s\n", num, filename);
+	out->len += len;
+}
 
-	errno = 0;
-	fd_skt = socket(AF_UNIX, SOCK_STREAM, 0);
-	check(fd_skt == -1, "Creazione socket nel Collector ha fallito: %s", strerror(errno));
+/**
+ * @brief	Trasforma i bit del risultato in una chiave che, confrontata come long,
+ * segue l'ordine dei valori del tipo: la trasformazione e' l'inversa di se stessa
+ */
+static long
+sort_key(farm_type_t type, long bits)
+{
+	if (type == FARM_U64)
+		return bits ^ INT64_MIN;
+	if (type == FARM_F64 && bits < 0)
+		return bits ^ INT64_MAX; // i double negativi crescono al decrescere dei bit
+	return bits;
+}
 
-	errno = 0;
-	r = bind(fd_skt, (struct sockaddr *)&sa, sizeof(sa));
-	check(r == -1, "Bind del socket nel Collector ha fallito: %s", strerror(errno));
+typedef struct coll_state
+{
+	out_buf_t out;
+	journal_t *journal;
+	int order;
+	farm_type_t type;
+	/* -o input: finestra circolare indicizzata per task id */
+	res_record_t *window;
+	char *present;
+	uint64_t next;
+	sem_t *credit;
+	/* -o result */
+	extsort_t *sort;
+} coll_state_t;
 
-	errno = 0;
-	r = listen(fd_skt, SOMAXCONN);
-	check(r == -1, "Listen nel socket del Collector ha fallito: %s", strerror(errno));
+/**
+ * @brief	Riceve un record dai Worker: lo registra nel journal (i record rigiocati
+ * dal journal non vengono riscritti) e lo stampa, lo mette nella finestra di riordino
+ * o lo passa all'ordinamento esterno a seconda di -o
+ */
+static void
+out_record(const res_record_t *rec, void *arg)
+{
+	coll_state_t *st = arg;
+
+	// il calcolo e' fallito: niente da registrare ne' da stampare
+	if (rec->err && st->order != ORDER_INPUT)
+		return;
+
+	if (st->journal && !rec->replay && !rec->err)
+	{
+		errno = 0;
+		int r = journalAppend(st->journal, rec->filename, rec->filesize, &rec->mtime, rec->result, rec->type, rec->be);
+		check(r == -1, "Scrittura del journal ha fallito: %s", strerror(errno));
+	}
 
+	if (st->order == ORDER_RESULT)
+	{
+		errno = 0;
+		int r = extsortAdd(st->sort, sort_key(rec->type, rec->result), rec->filename);
+		check(r == -1, "Ordinamento dei risultati ha fallito: %s", strerror(errno));
+	}
+	else if (st->order == ORDER_INPUT)
+	{
+		// il master non assegna id oltre next + REORDER_WINDOW: lo slot e' libero
+		size_t slot = rec->id % REORDER_WINDOW;
+		check(rec->id < st->next || rec->id >= st->next + REORDER_WINDOW || st->present[slot],
+				"Record %lu fuori dalla finestra di riordino (prossimo atteso %lu)",
+				(unsigned long)rec->id, (unsigned long)st->next);
+		st->window[slot] = *rec;
+		st->present[slot] = 1;
+		while (st->present[st->next % REORDER_WINDOW])
+		{
+			slot = st->next % REORDER_WINDOW;
+			if (!st->window[slot].err)
+				out_line(&st->out, st->window[slot].type, st->window[slot].result, st->window[slot].filename);
+			st->present[slot] = 0;
+			st->next += 1;
+			V(st->credit);
+		}
+	}
+	else
+	{
+		out_line(&st->out, rec->type, rec->result, rec->filename);
+	}
+}
+
+// nessun risultato da JOURNAL_SYNC_MS: le righe in sospeso del journal non
+// aspettano il prossimo record, che dietro un file grande puo' tardare minuti
+static void
+journal_idle(coll_state_t *st)
+{
 	errno = 0;
-	fd_c = accept(fd_skt, NULL, 0);
-	check(fd_c == -1, "Accetazione del client nel Collector ha fallito: %s", strerror(errno));
+	int r = journalSync(st->journal);
+	check(r == -1, "Scrittura del journal ha fallito: %s", strerror(errno));
+}
+
+// callback dell'ordinamento esterno con -o result
+static void
+out_sorted(long key, const char *filename, void *arg)
+{
+	coll_state_t *st = arg;
+	out_line(&st->out, st->type, sort_key(st->type, key), filename);
+}
+
+/**
+ * @brief	Routine del Collector con i ring condivisi: svuota tutti i ring e scrive
+ * i risultati con una sola write per passata, bloccandosi solo quando tutti i ring sono vuoti
+ */
+static void
+Collector_rings(ring_set_t *rings, coll_state_t *st)
+{
+	long timeout = st->journal ? JOURNAL_SYNC_MS : -1;
+	while (1)
+	{
+		errno = 0;
+		if (ringDrain(rings, out_record, st, timeout) > 0)
+			out_flush(&st->out);
+		else if (errno == ETIMEDOUT)
+			journal_idle(st);
+		else
+			break;
+	}
+	out_flush(&st->out);
+}
+
+/**
+ * @brief	Routine del Collector con il socket: legge un record alla volta,
+ * sincronizzandosi con i Worker tramite i semafori del segmento condiviso
+ */
+static void Collector_socket(int fd_c, shmsegment_t *shmptr, coll_state_t *st);
+
+static void
+Collector(int fd_c, shmsegment_t *shmptr, const coll_struct_t *opts)
+{
+	DBG("Collector is up\n", NULL);
+
+	coll_state_t *st = calloc(1, sizeof(coll_state_t));
+	check(st == NULL, "malloc del buffer del Collector ha fallito");
+	st->order = opts->order;
+	st->type = opts->type;
+	if (st->order == ORDER_INPUT)
+	{
+		st->window = malloc(REORDER_WINDOW * sizeof(res_record_t));
+		st->present = calloc(REORDER_WINDOW, 1);
+		check(st->window == NULL || st->present == NULL, "malloc della finestra di riordino ha fallito");
+		st->credit = &shmptr->credit;
+	}
+	if (st->order == ORDER_RESULT)
+	{
+		errno = 0;
+		st->sort = extsortInit(opts->sort_mem);
+		check(st->sort == NULL, "extsortInit ha fallito: %s", strerror(errno));
+	}
+	if (opts->journal)
+	{
+		errno = 0;
+		st->journal = journalOpen(opts->journal);
+		check(st->journal == NULL, "Apertura del journal %s ha fallito: %s", opts->journal, strerror(errno));
+	}
+
+	if (shmptr->rings)
+		Collector_rings(shmptr->rings, st);
+	else
+		Collector_socket(fd_c, shmptr, st);
+
+	// con -o input i task annullati lasciano dei buchi: i risultati gia' arrivati
+	// dopo il primo buco vengono stampati comunque, nell'ordine dei file
+	if (st->order == ORDER_INPUT && shmptr->cancelled)
+	{
+		for (uint64_t id = st->next; id < st->next + REORDER_WINDOW; id++)
+		{
+			res_record_t *rec = &st->window[id % REORDER_WINDOW];
+			if (st->present[id % REORDER_WINDOW] && !rec->err)
+				out_line(&st->out, rec->type, rec->result, rec->filename);
+		}
+		out_flush(&st->out);
+	}
+	// dopo un segnale di terminazione i risultati sono incompleti: restano solo nel journal
+	if (st->sort && !shmptr->cancelled)
+	{
+		errno = 0;
+		int r = extsortFinish(st->sort, out_sorted, st);
+		check(r == -1, "Ordinamento dei risultati ha fallito: %s", strerror(errno));
+		out_flush(&st->out);
+	}
+	extsortDelete(st->sort);
+	if (st->journal)
+		journalClose(st->journal);
+	free(st->window);
+	free(st->present);
+	free(st);
+}
+
+static void
+Collector_socket(int fd_c, shmsegment_t *shmptr, coll_state_t *st)
+{
+	int r;
 
 	/*----- COLLECTOR ROUTINE -----*/
 
-	int N = 1024;
-	char buf[N];
+	res_record_t rec;
 	V(&shmptr->semS);
 	while (1)
 	{
-		P(&shmptr->semC);
-		errno = 0;
-		r = read(fd_c, buf, N);
-		check(r == -1, "Funzione read dal socket nel Collector ha fallito: %s", strerror(errno));
-		if (r == 0)
+		if (st->journal)
+		{
+			struct timespec t;
+			clock_gettime(CLOCK_REALTIME, &t);
+			t.tv_nsec += JOURNAL_SYNC_MS * 1000000L;
+			t.tv_sec += t.tv_nsec / 1000000000L;
+			t.tv_nsec %= 1000000000L;
+			errno = 0;
+			r = sem_timedwait(&shmptr->semC, &t);
+			if (r == -1)
+			{
+				check(errno != ETIMEDOUT && errno != EINTR, "sem_timedwait nel Collector ha fallito: %s", strerror(errno));
+				if (errno == ETIMEDOUT)
+					journal_idle(st);
+				continue;
+			}
+		}
+		else
+			P(&shmptr->semC);
+		size_t got = 0;
+		while (got < sizeof(rec))
+		{
+			errno = 0;
+			r = read(fd_c, (char *)&rec + got, sizeof(rec) - got);
+			check(r == -1, "Funzione read dal socket nel Collector ha fallito: %s", strerror(errno));
+			if (r == 0)
+				break;
+			got += r;
+		}
+		if (got < sizeof(rec))
 		{
 			break;
 		}
-		errno = 0;
-		r = write(STDOUT_FILENO, buf, strlen(buf));
-		check(r == -1, "Funzione write nel Collector ha fallito: %s", strerror(errno));
+		out_record(&rec, st);
+		out_flush(&st->out);
 		V(&shmptr->semS);
 	}
-	close(fd_skt);
 	close(fd_c);
 }
 
-static void *Worker(void *arg)
+static void
+nap(long ms)
+{
+	while (ms > 0 && sig_term != 1)
+	{
+		long step = ms < NAP_STEP_MS ? ms : NAP_STEP_MS;
+		usleep(step * 1000);
+		ms -= step;
+	}
+}
+
+static void
+dispatch_file(m_struct_t *m, const char *name, int cls)
+{
+	// il nome viaggia nel record del Collector: uno troppo lungo si scarta come un file illeggibile
+	if (strlen(name) >= RECORD_NAME_LEN)
+	{
+		fprintf(stderr, "Nome del file %.64s... troppo lungo (massimo %d caratteri)\n", name, RECORD_NAME_LEN - 1);
+		return;
+	}
+	size_t filesize;
+	struct timespec mtime;
+	errno = 0;
+	if (file_info(name, &filesize, &mtime) != 1)
+	{
+		if (errno == 0)
+		{
+			fprintf(stderr, "%s non e' un file regolare\n", name);
+			return;
+		}
+		perror("isRegular");
+		return;
+	}
+	// il task id e' anche il numero d'ordine in uscita: con -o input il master
+	// non supera la finestra di riordino del Collector, i Worker restano liberi
+	if (m->credit)
+		P(m->credit);
+	if (sig_term == 1)
+		return;
+	f_struct_t *file = calloc(1, sizeof(f_struct_t));
+	check(file == NULL, "malloc del task ha fallito");
+	file->t.filename = strdup(name);
+	check(file->t.filename == NULL, "malloc del task ha fallito");
+	file->t.id = m->next_id++;
+	file->t.size = filesize;
+	file->t.type = m->type;
+	file->t.be = m->be;
+	file->t.prio = cls >= 0 ? cls : PRIO_DEFAULT;
+	// vince la regola con la directory piu' lunga che contiene il file
+	for (size_t i = 0, best = 0; cls < 0 && i < m->nrules; i++)
+	{
+		const prio_rule_t *rule = &m->rules[i];
+		if (rule->len > best && strncmp(name, rule->dir, rule->len) == 0 &&
+			(name[rule->len] == '/' || rule->dir[rule->len - 1] == '/'))
+		{
+			file->t.prio = rule->cls;
+			best = rule->len;
+		}
+	}
+	file->mtime = mtime;
+	file->t.done = journalLookup(m->jindex, name, filesize, &mtime, m->type, m->be, &file->t.result);
+
+	// i file gia' nel journal non vengono rallentati: il Worker li inoltra soltanto
+	if (!file->t.done)
+		nap(m->delay);
+	errno = 0;
+	int r = farmSubmit(m->th->engine, &file->t);
+	if (r == -1 && errno == ECANCELED)
+	{
+		free(file->t.filename);
+		free(file);
+		return;
+	}
+	check(r == -1, "Inserimento di %s nella coda ha fallito: %s", name, strerror(errno));
+}
+
+static farm_engine_t *
+new_engine(const farm_opts_t *o)
+{
+	errno = 0;
+	farm_engine_t *e = initFarm(o);
+	check(e == NULL && errno == EINVAL, "La finestra (-w) e il budget (-m) devono essere di almeno %ld byte", 2 * sysconf(_SC_PAGESIZE));
+	check(e == NULL, "initFarm ha fallito: %s", strerror(errno));
+	return e;
+}
+
+static void
+task_result(size_t worker, farm_task_t *t, void *arg)
 {
 	th_struct_t *th_struct = arg;
-	DBG("Start della routine del Worker\n", NULL);
+	f_struct_t *f = (f_struct_t *)t;
+	DBG("Risultato di %s (%zu bytes): %ld\n", t->filename, t->size, t->result);
+	// annullato da un segnale di terminazione: nessun record, il file non finisce nel journal
+	if (t->err == ECANCELED)
+	{
+		free(t->filename);
+		free(f);
+		return;
+	}
+	// un file illeggibile (qui o su un nodo remoto) non ferma gli altri: il record
+	// senza risultato serve solo a far avanzare la finestra di -o input
+	if (t->err != 0)
+		fprintf(stderr, "Elaborazione di %s ha fallito: %s\n", t->filename, strerror(t->err));
+
+	res_record_t rec;
+	memset(&rec, 0, sizeof(rec));
+	rec.err = t->err;
+	rec.result = t->result;
+	rec.type = t->type;
+	rec.be = t->be;
+	rec.id = t->id;
+	rec.filesize = t->size;
+	rec.mtime = f->mtime;
+	rec.replay = t->done;
+	strcpy(rec.filename, t->filename); // dispatch_file ha gia' scartato i nomi troppo lunghi
+	th_struct->emit(th_struct, worker, &rec);
+
+	free(t->filename);
+	free(f);
+}
+
+static void
+emit_socket(th_struct_t *th, size_t id, const res_record_t *rec)
+{
+	P(th->semS);
+	size_t sent = 0;
+	while (sent < sizeof(*rec))
+	{
+		errno = 0;
+		int r = write(th->fd_skt, (const char *)rec + sent, sizeof(*rec) - sent);
+		check(r == -1, "Funzione write nel Worker ha fallito: %s", strerror(errno));
+		sent += r;
+	}
+	V(th->semC);
+}
+
+static void
+emit_ring(th_struct_t *th, size_t id, const res_record_t *rec)
+{
+	errno = 0;
+	int r = ringPush(th->rings, id, rec);
+	check(r == -1, "ringPush nel Worker ha fallito: %s", strerror(errno));
+}
+
+static void
+node_result(size_t worker, farm_task_t *t, void *arg)
+{
+	th_struct_t *th = arg;
+	// un file che il nodo non riesce a leggere non lo fa terminare: l'errore lo riporta il coordinatore
+	P(th->semS);
+	errno = 0;
+	int r = netSendResult(th->fd_skt, t->id, t->result, t->err);
+	check(r == -1, "Invio del risultato al coordinatore ha fallito: %s", strerror(errno));
+	V(th->semS);
+	free(t->filename);
+	free(t);
+}
+
+/*----- COORDINATORE -----*/
+
+/**
+ * @brief	Start routine del thread che invia i task della coda a un nodo remoto.
+ * Tiene al piu' slot->window task in volo; i risultati li riceve Node_Receiver
+ */
+static void *
+Node_Sender(void *arg)
+{
+	node_slot_t *slot = arg;
+	th_struct_t *th = slot->coord->th;
+	size_t ring = slot->coord->ring_base + 2 * slot->id + 1;
+
 	while (1)
+	{
+		P(&slot->win);
+		if (slot->dead)
+			break;
+
+		// attesa limitata: se il nodo cade mentre la coda e' vuota il sender se ne accorge
+		struct timespec t;
+		clock_gettime(CLOCK_REALTIME, &t);
+		t.tv_nsec += NODE_POLL_MS * 1000000L;
+		t.tv_sec += t.tv_nsec / 1000000000L;
+		t.tv_nsec %= 1000000000L;
+		f_struct_t *f = (f_struct_t *)farmTake(th->engine, &t);
+		if (f == NULL && errno == ETIMEDOUT)
+		{
+			V(&slot->win);
+			continue;
+		}
+		if (f == NULL)
+		{
+			netSendBye(slot->fd);
+			break;
+		}
+		if (f->t.done)
+		{
+			farmComplete(th->engine, ring, &f->t);
+			V(&slot->win);
+			continue;
+		}
+
+		LOCK(&slot->m);
+		if (slot->dead)
+		{
+			UNLOCK(&slot->m);
+			farmRequeue(th->engine, &f->t);
+			break;
+		}
+		size_t i = 0;
+		while (slot->inflight[i] != NULL)
+			i++;
+		slot->inflight[i] = f;
+		UNLOCK(&slot->m);
+
+		// se l'invio fallisce il receiver vede la connessione chiusa e rimette f nella coda
+		if (netSendTask(slot->fd, f->t.id, f->t.size, f->t.type, f->t.be, f->t.filename) == -1)
+		{
+			shutdown(slot->fd, SHUT_RDWR);
+			break;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * @brief	Start routine del thread che riceve i risultati da un nodo remoto e li inoltra
+ * al Collector. Alla chiusura della connessione rimette nella coda i task ancora in volo
+ */
+static void *
+Node_Receiver(void *arg)
+{
+	node_slot_t *slot = arg;
+	coord_struct_t *coord = slot->coord;
+	th_struct_t *th = coord->th;
+	size_t ring = coord->ring_base + 2 * slot->id;
+
+	int err = pthread_create(&slot->sender, NULL, Node_Sender, slot);
+	check(err != 0, "pthread_create Node_Sender ha fallito: %s", strerror(err));
+
+	uint64_t id;
+	long result;
+	int task_err;
+	while (netRecvResult(slot->fd, &id, &result, &task_err) == 1)
 	{
 		f_struct_t *f = NULL;
-		f = pop(th_struct->q);
-		if (f == EOS)
+		LOCK(&slot->m);
+		for (size_t i = 0; i < slot->window && f == NULL; i++)
+		{
+			if (slot->inflight[i] != NULL && slot->inflight[i]->t.id == id)
+			{
+				f = slot->inflight[i];
+				slot->inflight[i] = NULL;
+			}
+		}
+		UNLOCK(&slot->m);
+		if (f == NULL)
 		{
+			fprintf(stderr, "Il nodo %zu ha inviato un risultato per un task sconosciuto\n", slot->id);
 			break;
 		}
-		DBG("File ricevuto: %s con dimensione di %ld bytes\n", f->filename, f->filesize);
 
-		/*----- RESULT COMPUTATION -----*/
+		f->t.result = result;
+		f->t.err = task_err;
+		farmComplete(th->engine, ring, &f->t);
+		V(&slot->win);
+	}
 
-		long *content = NULL;
-		mmap_file(f->filename, &content, f->filesize);
+	LOCK(&slot->m);
+	slot->dead = 1;
+	UNLOCK(&slot->m);
+	shutdown(slot->fd, SHUT_RDWR);
+	V(&slot->win);
 
-		long result = 0;
-		for (size_t i = 0; i < f->filesize / 8; i++)
+	size_t requeued = 0;
+	for (size_t i = 0; i < slot->window; i++)
+	{
+		if (slot->inflight[i] != NULL)
 		{
-			result += (i * content[i]);
+			farmRequeue(th->engine, &slot->inflight[i]->t);
+			slot->inflight[i] = NULL;
+			requeued++;
 		}
+	}
+	if (requeued > 0 && sig_term != 1)
+		fprintf(stderr, "Nodo %zu disconnesso: %zu task riassegnati\n", slot->id, requeued);
+
+	err = pthread_join(slot->sender, NULL);
+	check(err != 0, "pthread_join di Node_Sender ha fallito: %s", strerror(err));
+	free(slot->inflight);
+	sem_destroy(&slot->win);
+	pthread_mutex_destroy(&slot->m);
+
+	// chiuso sotto il lock: coord_cancel non puo' fare shutdown di un descrittore riusato
+	LOCK(&coord->m);
+	close(slot->fd);
+	slot->busy = 0;
+	coord->active -= 1;
+	SIGNAL(&coord->c);
+	UNLOCK(&coord->m);
+	return NULL;
+}
 
-		int len = (snprintf(NULL, 0, "%ld %s\n", result, f->filename)) + 1;
-		char res[len];
-		snprintf(res, len, "%ld %s\n", result, f->filename);
+static void *
+Acceptor(void *arg)
+{
+	coord_struct_t *coord = arg;
+	while (1)
+	{
+		int fd = accept(coord->fd_listen, NULL, 0);
+		if (fd == -1)
+		{
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+			break; // shutdown del socket in ascolto a fine lavoro
+		}
+		uint32_t nthreads;
+		if (netRecvHello(fd, &nthreads) == -1 || nthreads == 0)
+		{
+			close(fd);
+			continue;
+		}
 
-		P(th_struct->semS);
+		LOCK(&coord->m);
+		node_slot_t *slot = NULL;
+		for (size_t i = 0; i < NODE_SLOTS && slot == NULL; i++)
+			if (!coord->slot[i].busy)
+				slot = &coord->slot[i];
+		if (slot == NULL)
+		{
+			UNLOCK(&coord->m);
+			fprintf(stderr, "Troppi nodi connessi (massimo %d): connessione rifiutata\n", NODE_SLOTS);
+			close(fd);
+			continue;
+		}
+		slot->busy = 1;
+		slot->fd = fd;
+		coord->active += 1;
+		UNLOCK(&coord->m);
+
+		// due task in volo per thread: il nodo ha sempre il prossimo task gia' in coda
+		slot->dead = 0;
+		slot->window = 2 * (size_t)nthreads;
+		slot->inflight = calloc(slot->window, sizeof(f_struct_t *));
+		check(slot->inflight == NULL, "malloc dei task in volo ha fallito");
+		int err = pthread_mutex_init(&slot->m, NULL);
+		check(err != 0, "pthread_mutex_init ha fallito: %s", strerror(err));
 		errno = 0;
-		int r = write(th_struct->fd_skt, res, len);
-		check(r == -1, "Funzione write nel Worker ha fallito: %s", strerror(errno));
-		V(th_struct->semC);
-
-		munmap(content, f->filesize);
-		free(f->filename);
-		free(f);
+		err = sem_init(&slot->win, 0, slot->window);
+		check(err == -1, "sem_init ha fallito: %s", strerror(errno));
+		DBG("Nodo %zu connesso con %u thread\n", slot->id, nthreads);
+
+		pthread_t receiver;
+		err = pthread_create(&receiver, NULL, Node_Receiver, slot);
+		check(err != 0, "pthread_create Node_Receiver ha fallito: %s", strerror(err));
+		pthread_detach(receiver);
 	}
-	push(th_struct->q, EOS);
-	DBG("Chiusura del Worker\n", NULL);
 	return NULL;
 }
 
-void mmap_file(const char *file_name, long **content_ptr, size_t size)
+static void
+coord_cancel(coord_struct_t *coord)
 {
-	int fd;
+	LOCK(&coord->m);
+	for (size_t i = 0; i < NODE_SLOTS; i++)
+		if (coord->slot[i].busy)
+			shutdown(coord->slot[i].fd, SHUT_RDWR);
+	UNLOCK(&coord->m);
+}
+
+/*----- NODO WORKER -----*/
+
+static int
+run_node(const char *addr, farm_opts_t *o)
+{
+	// la rilettura dei limiti e' del coordinatore: qui SIGUSR2 non deve terminare il nodo
+	struct sigaction s;
+	memset(&s, 0, sizeof(s));
+	s.sa_handler = SIG_IGN;
 	errno = 0;
-	fd = open(file_name, O_RDONLY);
-	check(fd < 0, "Funzione open %s ha fallito: %s", file_name, strerror(errno));
-	*content_ptr = mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0);
-	check(*content_ptr == MAP_FAILED, "Funzione mmap %s ha fallito: %s", file_name, strerror(errno));
+	int err = sigaction(SIGUSR2, &s, NULL);
+	check(err == -1, "Errore nell'ignorare il segnale SIGUSR2: %s", strerror(errno));
+
+	int fd = -1;
+	for (int i = 0; i < NODE_RETRIES && (fd = netConnect(addr)) == -1; i++)
+		usleep(RECONNECT); // il coordinatore potrebbe non essere ancora in ascolto
+	check(fd == -1, "Connessione al coordinatore %s ha fallito: %s", addr, strerror(errno));
+
+	errno = 0;
+	err = netSendHello(fd, o->nthreads);
+	check(err == -1, "Invio dell'HELLO al coordinatore ha fallito: %s", strerror(errno));
+
+	sem_t wsem;
+	errno = 0;
+	err = sem_init(&wsem, 0, 1);
+	check(err == -1, "sem_init ha fallito: %s", strerror(errno));
+
+	th_struct_t *th_struct = calloc(1, sizeof(th_struct_t));
+	check(th_struct == NULL, "malloc di th_struct ha fallito");
+	th_struct->fd_skt = fd;
+	th_struct->semS = &wsem;
+	o->cb = node_result;
+	o->arg = th_struct;
+	th_struct->engine = new_engine(o);
+
+	// tipo degli elementi e ordine dei byte arrivano con ogni task: un nodo lanciato
+	// con -T o --be diversi dal coordinatore non calcola il file come un altro tipo
+	char name[RECORD_NAME_LEN];
+	uint32_t type, elem;
+	uint64_t id, size;
+	int be;
+	while (netRecvTask(fd, &type, &id, &size, &elem, &be, name, sizeof(name)) == 1 && type == NET_TASK)
+	{
+		farm_task_t *t = calloc(1, sizeof(farm_task_t));
+		check(t == NULL, "malloc del task ha fallito");
+		t->filename = strdup(name);
+		check(t->filename == NULL, "malloc del task ha fallito");
+		t->id = id;
+		t->size = size;
+		// un tipo sconosciuto torna al coordinatore come errore del file (EINVAL)
+		t->type = elem < FARM_NTYPES ? (farm_type_t)elem : FARM_NTYPES;
+		t->be = be;
+		errno = 0;
+		err = farmSubmit(th_struct->engine, t);
+		check(err == -1, "Inserimento di %s nella coda ha fallito: %s", name, strerror(errno));
+	}
+
+	deleteFarm(th_struct->engine);
+	free(th_struct);
+	sem_destroy(&wsem);
 	close(fd);
-}
\ No newline at end of file
+	return 0;
+}
@@ -8,12 +8,56 @@
 #include <sys/mman.h>
 #include <time.h>
 #include <assert.h>
+#include <string.h>
+
+#include "codec.h"
+
+// scrive gli stessi valori nel formato compatto (vedi codec.h)
+static int genera_compatto(const char *nome, long nelem)
+{
+  // codecWrite codifica un blocco alla volta in un buffer suo: qui servono solo
+  // i valori (nessuno per un file vuoto, che codecWrite accetta con v NULL)
+  long *v = nelem > 0 ? malloc(nelem * sizeof(long)) : NULL;
+  if (nelem > 0 && v == NULL)
+  {
+    perror("malloc");
+    return -1;
+  }
+  FILE *fp = fopen(nome, "w");
+  if (fp == NULL)
+  {
+    perror("fopen");
+    free(v);
+    return -1;
+  }
+  unsigned int seed = 331777;
+  long sum = 0;
+  for (long i = 0; i < nelem; ++i)
+  {
+    v[i] = (long)(rand_r(&seed) / 12345678.0);
+    sum += i * v[i];
+  }
+  int err = codecWrite(fp, v, nelem);
+  if (err == -1)
+    perror("codecWrite");
+  free(v);
+  // fp si chiude anche dopo un errore di codecWrite
+  if (fclose(fp) == EOF && err == 0)
+  {
+    perror("fclose");
+    err = -1;
+  }
+  if (err == -1)
+    return -1;
+  fprintf(stdout, "risultato atteso: %ld\n", sum);
+  return 0;
+}
 
 int main(int argc, char *argv[])
 {
-  if (argc != 3)
+  if (argc != 3 && !(argc == 4 && strcmp(argv[3], "-z") == 0))
   {
-    fprintf(stderr, "usa: %s nome nelem\n", argv[0]);
+    fprintf(stderr, "usa: %s nome nelem [-z]\n", argv[0]);
     return -1;
   }
 
@@ -26,6 +70,9 @@ int main(int argc, char *argv[])
     return -1;
   }
 
+  if (argc == 4)
+    return genera_compatto(nome, nelem);
+
   int fd = open(nome, O_CREAT | O_TRUNC | O_RDWR, 0644);
   if (fd == -1)
   {
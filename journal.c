@@ -0,0 +1,309 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "journal.h"
+
+/**
+ * @file journal.c
+ * @brief File di implementazione del journal dei file gia' elaborati
+ */
+
+#define JOURNAL_BUFSIZE  (1 << 16)
+
+struct journal {
+    int              fd;
+    size_t           pending;     // righe non ancora rese persistenti
+    struct timespec  last_sync;
+    size_t           len;
+    char             buf[JOURNAL_BUFSIZE];
+};
+
+typedef struct j_entry {
+    char            *filename;
+    size_t           size;
+    struct timespec  mtime;
+    long             result;
+    int              type;
+    int              be;
+    struct j_entry  *next;
+} j_entry_t;
+
+struct journal_index {
+    j_entry_t  **bucket;
+    size_t       nbuckets;
+    size_t       nentries;
+};
+
+
+/* ------------------- funzioni di utilita' -------------------- */
+
+static inline size_t Hash(const char *s) {
+    size_t h = 14695981039346656037UL;    // FNV-1a
+    for (; *s; s++) h = (h ^ (unsigned char)*s) * 1099511628211UL;
+    return h;
+}
+
+static inline long ElapsedMs(const struct timespec *from) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - from->tv_sec) * 1000 + (now.tv_nsec - from->tv_nsec) / 1000000;
+}
+
+static int WriteAll(int fd, const char *p, size_t len) {
+    while (len > 0) {
+	ssize_t r = write(fd, p, len);
+	if (r == -1) {
+	    if (errno == EINTR) continue;
+	    return -1;
+	}
+	p += r;
+	len -= r;
+    }
+    return 0;
+}
+
+static int Flush(journal_t *j) {
+    if (WriteAll(j->fd, j->buf, j->len) == -1) return -1;
+    j->len = 0;
+    return 0;
+}
+
+// taglia l'ultima riga se non ha il '\n' finale (scrittura interrotta): altrimenti
+// la prossima riga aggiunta le si attaccherebbe e andrebbe persa in lettura
+static int TrimTorn(int fd) {
+    struct stat st;
+    if (fstat(fd, &st) == -1) return -1;
+    char buf[4096];
+    off_t end = st.st_size;
+    while (end > 0) {
+	size_t n = end < (off_t)sizeof(buf) ? (size_t)end : sizeof(buf);
+	ssize_t r = pread(fd, buf, n, end - n);
+	if (r == -1) {
+	    if (errno == EINTR) continue;
+	    return -1;
+	}
+	if ((size_t)r != n) {
+	    errno = EIO;
+	    return -1;
+	}
+	for (size_t i = n; i-- > 0;) {
+	    if (buf[i] == '\n') {
+		off_t keep = end - n + i + 1;
+		return keep == st.st_size ? 0 : ftruncate(fd, keep);
+	    }
+	}
+	end -= n;
+    }
+    return st.st_size == 0 ? 0 : ftruncate(fd, 0);
+}
+
+static j_entry_t **Find(journal_index_t *ix, const char *filename) {
+    j_entry_t **e = &ix->bucket[Hash(filename) & (ix->nbuckets - 1)];
+    while (*e && strcmp((*e)->filename, filename) != 0) e = &(*e)->next;
+    return e;
+}
+
+static int Grow(journal_index_t *ix) {
+    size_t n = ix->nbuckets * 2;
+    j_entry_t **b = calloc(n, sizeof(j_entry_t *));
+    if (!b) return -1;
+    for (size_t i = 0; i < ix->nbuckets; i++) {
+	j_entry_t *e = ix->bucket[i];
+	while (e) {
+	    j_entry_t *next = e->next;
+	    size_t h = Hash(e->filename) & (n - 1);
+	    e->next = b[h];
+	    b[h] = e;
+	    e = next;
+	}
+    }
+    free(ix->bucket);
+    ix->bucket = b;
+    ix->nbuckets = n;
+    return 0;
+}
+
+/* ------------------- scrittura del journal ------------------- */
+
+journal_t *journalOpen(const char *path) {
+    if (!path) {
+	errno = EINVAL;
+	return NULL;
+    }
+    journal_t *j = malloc(sizeof(journal_t));
+    if (!j) return NULL;
+    j->fd = open(path, O_RDWR | O_APPEND | O_CREAT, 0644);
+    if (j->fd == -1 || TrimTorn(j->fd) == -1) {
+	int myerrno = errno;
+	if (j->fd != -1) close(j->fd);
+	free(j);
+	errno = myerrno;
+	return NULL;
+    }
+    j->pending = 0;
+    j->len = 0;
+    clock_gettime(CLOCK_MONOTONIC, &j->last_sync);
+    return j;
+}
+
+int journalAppend(journal_t *j, const char *filename, size_t size,
+		  const struct timespec *mtime, long result, int type, int be) {
+    if (!j || !filename || !mtime || type < 0) {
+	errno = EINVAL;
+	return -1;
+    }
+    // un nome con '\n' romperebbe il formato a righe: il file non viene registrato
+    if (strchr(filename, '\n')) return 0;
+
+    // i long little-endian non hanno etichetta: le righe restano quelle dei journal precedenti
+    char tag[16] = "";
+    if (type != 0 || be) snprintf(tag, sizeof(tag), "@%d%s", type, be ? "b" : "");
+    int len = snprintf(NULL, 0, "%zu %ld %ld %ld%s %s\n", size,
+		       (long)mtime->tv_sec, mtime->tv_nsec, result, tag, filename);
+    if (len + 1 > JOURNAL_BUFSIZE) {
+	errno = ENAMETOOLONG;
+	return -1;
+    }
+    if (j->len + len + 1 > JOURNAL_BUFSIZE && Flush(j) == -1) return -1;
+    snprintf(j->buf + j->len, JOURNAL_BUFSIZE - j->len, "%zu %ld %ld %ld%s %s\n", size,
+	     (long)mtime->tv_sec, mtime->tv_nsec, result, tag, filename);
+    j->len += len;
+    j->pending += 1;
+
+    if (j->pending >= JOURNAL_BATCH || ElapsedMs(&j->last_sync) >= JOURNAL_SYNC_MS)
+	return journalSync(j);
+    return 0;
+}
+
+int journalSync(journal_t *j) {
+    if (!j) {
+	errno = EINVAL;
+	return -1;
+    }
+    if (j->pending == 0) return 0;
+    if (Flush(j) == -1) return -1;
+    if (fsync(j->fd) == -1) return -1;
+    j->pending = 0;
+    clock_gettime(CLOCK_MONOTONIC, &j->last_sync);
+    return 0;
+}
+
+void journalClose(journal_t *j) {
+    if (!j) {
+	errno = EINVAL;
+	return;
+    }
+    if (journalSync(j) == -1) perror("journalSync");
+    close(j->fd);
+    free(j);
+}
+
+/* ------------------- lettura del journal --------------------- */
+
+journal_index_t *journalLoad(const char *path) {
+    if (!path) {
+	errno = EINVAL;
+	return NULL;
+    }
+    journal_index_t *ix = calloc(1, sizeof(journal_index_t));
+    if (!ix) return NULL;
+    ix->nbuckets = 1024;
+    ix->bucket = calloc(ix->nbuckets, sizeof(j_entry_t *));
+    if (!ix->bucket) goto error;
+
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+	if (errno == ENOENT) return ix;
+	goto error;
+    }
+    char *line = NULL;
+    size_t cap = 0;
+    ssize_t len;
+    while ((len = getline(&line, &cap, fp)) != -1) {
+	if (line[len - 1] != '\n') break;    // ultima riga troncata
+	line[len - 1] = '\0';
+
+	size_t size;
+	long sec, nsec, result;
+	int type = 0, be = 0, off = 0, toff = 0;
+	if (sscanf(line, "%zu %ld %ld %ld%n", &size, &sec, &nsec, &result, &off) != 4 || off == 0)
+	    continue;                        // riga malformata
+	if (line[off] == '@' && (sscanf(line + off, "@%d%n", &type, &toff) != 1 || type < 0))
+	    continue;
+	off += toff;
+	if (toff > 0 && line[off] == 'b') {
+	    be = 1;
+	    off++;
+	}
+	// un solo spazio separa il nome, che puo' a sua volta iniziare con uno spazio
+	if (line[off] != ' ') continue;
+	off++;
+	if (line[off] == '\0') continue;
+
+	j_entry_t **e = Find(ix, line + off);
+	if (!*e) {
+	    *e = calloc(1, sizeof(j_entry_t));
+	    if (!*e || !((*e)->filename = strdup(line + off))) {
+		free(*e);
+		*e = NULL;
+		free(line);
+		fclose(fp);
+		goto error;
+	    }
+	    ix->nentries += 1;
+	}
+	(*e)->size = size;
+	(*e)->mtime.tv_sec = sec;
+	(*e)->mtime.tv_nsec = nsec;
+	(*e)->result = result;
+	(*e)->type = type;
+	(*e)->be = be;
+	if (ix->nentries > ix->nbuckets && Grow(ix) == -1) {
+	    free(line);
+	    fclose(fp);
+	    goto error;
+	}
+    }
+    free(line);
+    fclose(fp);
+    return ix;
+ error:;
+    int myerrno = errno;
+    journalFreeIndex(ix);
+    errno = myerrno;
+    return NULL;
+}
+
+int journalLookup(journal_index_t *ix, const char *filename, size_t size,
+		  const struct timespec *mtime, int type, int be, long *result) {
+    if (!ix || !filename || !mtime || !result) return 0;
+    j_entry_t *e = *Find(ix, filename);
+    if (!e || e->size != size || e->mtime.tv_sec != mtime->tv_sec ||
+	e->mtime.tv_nsec != mtime->tv_nsec || e->type != type || e->be != !!be)
+	return 0;
+    *result = e->result;
+    return 1;
+}
+
+void journalFreeIndex(journal_index_t *ix) {
+    if (!ix) return;
+    for (size_t i = 0; ix->bucket && i < ix->nbuckets; i++) {
+	j_entry_t *e = ix->bucket[i];
+	while (e) {
+	    j_entry_t *next = e->next;
+	    free(e->filename);
+	    free(e);
+	    e = next;
+	}
+    }
+    free(ix->bucket);
+    free(ix);
+}
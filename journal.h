@@ -0,0 +1,80 @@
+#if !defined(JOURNAL_H)
+#define JOURNAL_H
+
+#include <stddef.h>
+#include <time.h>
+
+/** Journal dei file gia' elaborati, in sola aggiunta.
+ *
+ *  Ogni riga ha la forma:  size mtime_sec mtime_nsec result[@type[b]] filename\n
+ *  dove type e' il tipo degli elementi con cui e' stato calcolato il risultato
+ *  (farm_type_t) e 'b' indica elementi big-endian; l'etichetta manca per i
+ *  long little-endian (tipo 0).
+ *  Una riga senza '\n' finale (scrittura interrotta) viene ignorata in lettura;
+ *  se lo stesso file compare piu' volte vale l'ultima riga.
+ */
+
+#if !defined(JOURNAL_BATCH)
+#define JOURNAL_BATCH    64      // righe tra due fsync
+#endif
+
+#if !defined(JOURNAL_SYNC_MS)
+#define JOURNAL_SYNC_MS  1000    // tempo massimo tra due fsync con righe in sospeso
+#endif
+
+typedef struct journal journal_t;
+typedef struct journal_index journal_index_t;
+
+
+/** Apre (o crea) il journal \param path in scrittura, in coda al contenuto esistente.
+ *
+ *   \retval NULL se errore (errno settato)
+ *   \retval j puntatore al journal aperto
+ */
+journal_t *journalOpen(const char *path);
+
+/** Aggiunge una riga al journal. Le righe vengono scritte e rese persistenti
+ *  con fsync a gruppi di JOURNAL_BATCH, o dopo JOURNAL_SYNC_MS millisecondi.
+ *  Il tempo si controlla solo qui: chi smette di aggiungere righe per piu' di
+ *  JOURNAL_SYNC_MS deve chiamare journalSync.
+ *
+ *   \retval 0 se successo
+ *   \retval -1 se errore (errno settato opportunamente)
+ */
+int journalAppend(journal_t *j, const char *filename, size_t size,
+		  const struct timespec *mtime, long result, int type, int be);
+
+/** Scrive le righe in sospeso e fa fsync del journal.
+ *
+ *   \retval 0 se successo
+ *   \retval -1 se errore (errno settato opportunamente)
+ */
+int journalSync(journal_t *j);
+
+/** Fa journalSync, chiude il journal e libera la memoria.
+ */
+void journalClose(journal_t *j);
+
+/** Legge il journal \param path e costruisce l'indice per nome del file.
+ *  Se il journal non esiste ritorna un indice vuoto.
+ *
+ *   \retval NULL se errore (errno settato)
+ *   \retval ix puntatore all'indice
+ */
+journal_index_t *journalLoad(const char *path);
+
+/** Cerca \param filename nell'indice. Il file e' considerato gia' elaborato
+ *  solo se dimensione, mtime, tipo \param type e ordine dei byte \param be
+ *  coincidono con quelli registrati.
+ *
+ *   \retval 1 se trovato (e \param result settato)
+ *   \retval 0 altrimenti
+ */
+int journalLookup(journal_index_t *ix, const char *filename, size_t size,
+		  const struct timespec *mtime, int type, int be, long *result);
+
+/** Libera un indice allocato con journalLoad.
+ */
+void journalFreeIndex(journal_index_t *ix);
+
+#endif /* JOURNAL_H */
@@ -0,0 +1,77 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "util.h"
+#include "membudget.h"
+
+/**
+ * @file membudget.c
+ * @brief File di implementazione del budget di memoria dei Worker
+ */
+
+
+/* ------------------- interfaccia del budget ------------------ */
+
+membudget_t *initBudget(size_t limit) {
+    if (limit == 0) {
+	errno = EINVAL;
+	return NULL;
+    }
+    membudget_t *b = calloc(1, sizeof(membudget_t));
+    if (!b) return NULL;
+    if (pthread_mutex_init(&b->m, NULL) != 0) {
+	free(b);
+	return NULL;
+    }
+    if (pthread_cond_init(&b->c, NULL) != 0) {
+	pthread_mutex_destroy(&b->m);
+	free(b);
+	return NULL;
+    }
+    b->limit = limit;
+    return b;
+}
+
+int budgetAcquire(membudget_t *b, size_t n) {
+    if (!b) return 0;
+    if (n > b->limit) {
+	errno = EINVAL;
+	return -1;
+    }
+    LOCK(&b->m);
+    while (b->used + n > b->limit && !b->cancelled)
+	WAIT(&b->c, &b->m);
+    if (b->cancelled) {
+	UNLOCK(&b->m);
+	errno = ECANCELED;
+	return -1;
+    }
+    b->used += n;
+    UNLOCK(&b->m);
+    return 0;
+}
+
+void budgetRelease(membudget_t *b, size_t n) {
+    if (!b) return;
+    LOCK(&b->m);
+    b->used -= n;
+    BCAST(&b->c);
+    UNLOCK(&b->m);
+}
+
+void budgetCancel(membudget_t *b) {
+    if (!b) return;
+    LOCK(&b->m);
+    b->cancelled = 1;
+    BCAST(&b->c);
+    UNLOCK(&b->m);
+}
+
+void deleteBudget(membudget_t *b) {
+    if (!b) return;
+    pthread_mutex_destroy(&b->m);
+    pthread_cond_destroy(&b->c);
+    free(b);
+}
@@ -0,0 +1,48 @@
+#if !defined(MEMBUDGET_H)
+#define MEMBUDGET_H
+
+#include <pthread.h>
+#include <stddef.h>
+
+/** Budget globale di memoria mappata, condiviso dai Worker.
+ *
+ *  Prima di mappare una finestra di un file il Worker ne prenota la dimensione
+ *  e la restituisce dopo la munmap: la somma delle finestre mappate non supera
+ *  mai 'limit', qualunque sia la dimensione dei file in input.
+ */
+typedef struct membudget {
+    size_t           limit;
+    size_t           used;
+    int              cancelled;
+    pthread_mutex_t  m;
+    pthread_cond_t   c;
+} membudget_t;
+
+
+/** Alloca un budget di \param limit byte.
+ *
+ *   \retval NULL se errore (errno settato)
+ *   \retval b puntatore al budget
+ */
+membudget_t *initBudget(size_t limit);
+
+/** Prenota \param n byte, bloccandosi finche' non sono disponibili.
+ *  Con \param b NULL ritorna subito.
+ *
+ *   \retval 0 se successo
+ *   \retval -1 se \param n supera il limite (errno settato a EINVAL) o se il
+ *           budget e' stato annullato con budgetCancel (errno settato a ECANCELED)
+ */
+int budgetAcquire(membudget_t *b, size_t n);
+
+/** Restituisce \param n byte prenotati e risveglia i Worker in attesa.
+ */
+void budgetRelease(membudget_t *b, size_t n);
+
+/** Risveglia i Worker in attesa: da qui in poi budgetAcquire fallisce con ECANCELED.
+ */
+void budgetCancel(membudget_t *b);
+
+void deleteBudget(membudget_t *b);
+
+#endif /* MEMBUDGET_H */
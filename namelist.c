@@ -0,0 +1,128 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "namelist.h"
+
+/**
+ * @file namelist.c
+ * @brief File di implementazione della lettura incrementale della lista dei file
+ */
+
+struct nlist {
+    int     fd;
+    char    sep;
+    int     eof;
+    char   *buf;
+    size_t  cap;
+    size_t  start;    // inizio del prossimo nome non ancora restituito
+    size_t  len;      // byte validi nel buffer
+    const volatile sig_atomic_t *stop;    // NULL se la lettura non si annulla
+};
+
+
+/* ------------------- funzioni di utilita' -------------------- */
+
+// sposta in testa il nome incompleto e legge altri dati; raddoppia il buffer
+// solo se un singolo nome non ci sta
+static int Fill(nlist_t *l) {
+    if (l->start > 0) {
+	memmove(l->buf, l->buf + l->start, l->len - l->start);
+	l->len -= l->start;
+	l->start = 0;
+    }
+    if (l->len == l->cap) {
+	char *b = realloc(l->buf, l->cap * 2 + 1);
+	if (!b) return -1;
+	l->buf = b;
+	l->cap *= 2;
+    }
+    // senza flag una read bloccante; con il flag si aspetta l'ingresso a intervalli
+    struct pollfd pfd = { l->fd, POLLIN, 0 };
+    int ready;
+    while (l->stop && (ready = poll(&pfd, 1, NLIST_POLL_MS)) != 1) {
+	if (ready == -1 && errno != EINTR) return -1;
+	if (*l->stop) {
+	    errno = ECANCELED;
+	    return -1;
+	}
+    }
+    ssize_t r;
+    do {
+	r = read(l->fd, l->buf + l->len, l->cap - l->len);
+    } while (r == -1 && errno == EINTR);
+    if (r == -1) return -1;
+    if (r == 0) l->eof = 1;
+    l->len += r;
+    return 0;
+}
+
+/* ------------------- interfaccia della lista ----------------- */
+
+nlist_t *nlistOpen(const char *path, char sep) {
+    if (!path) {
+	errno = EINVAL;
+	return NULL;
+    }
+    nlist_t *l = calloc(1, sizeof(nlist_t));
+    if (!l) return NULL;
+    l->sep = sep;
+    l->cap = NLIST_BUFSIZE;
+    l->buf = malloc(l->cap + 1);    // +1 per il terminatore dell'ultimo nome
+    if (!l->buf) goto error;
+    l->fd = strcmp(path, "-") == 0 ? STDIN_FILENO : open(path, O_RDONLY);
+    if (l->fd == -1) goto error;
+#if defined(POSIX_FADV_SEQUENTIAL)
+    posix_fadvise(l->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    return l;
+ error:;
+    int myerrno = errno;
+    free(l->buf);
+    free(l);
+    errno = myerrno;
+    return NULL;
+}
+
+const char *nlistNext(nlist_t *l) {
+    if (!l) {
+	errno = EINVAL;
+	return NULL;
+    }
+    while (1) {
+	char *p = memchr(l->buf + l->start, l->sep, l->len - l->start);
+	if (p) {
+	    char *name = l->buf + l->start;
+	    *p = '\0';
+	    l->start = p - l->buf + 1;
+	    if (*name) return name;
+	    continue;
+	}
+	if (l->eof) {
+	    // ultimo nome senza separatore finale
+	    errno = 0;
+	    if (l->start == l->len) return NULL;
+	    char *name = l->buf + l->start;
+	    l->buf[l->len] = '\0';
+	    l->start = l->len;
+	    return name;
+	}
+	if (Fill(l) == -1) return NULL;
+    }
+}
+
+void nlistSetCancel(nlist_t *l, const volatile sig_atomic_t *stop) {
+    if (l) l->stop = stop;
+}
+
+void nlistClose(nlist_t *l) {
+    if (!l) return;
+    if (l->fd != STDIN_FILENO) close(l->fd);
+    free(l->buf);
+    free(l);
+}
@@ -0,0 +1,48 @@
+#if !defined(NAMELIST_H)
+#define NAMELIST_H
+
+/** Lettura incrementale di una lista di nomi di file, separati da '\n' o da '\0'.
+ *  La lista viene letta a blocchi di NLIST_BUFSIZE byte, per cui la memoria
+ *  usata non dipende dalla lunghezza della lista ma solo dal nome piu' lungo.
+ */
+
+#include <signal.h>
+
+#if !defined(NLIST_BUFSIZE)
+#define NLIST_BUFSIZE (1 << 20)
+#endif
+
+#if !defined(NLIST_POLL_MS)
+#define NLIST_POLL_MS 10    // ogni quanto si ricontrolla il flag di nlistSetCancel
+#endif
+
+typedef struct nlist nlist_t;
+
+
+/** Apre la lista \param path ("-" per lo standard input).
+ *
+ *   \param sep separatore dei nomi ('\n' oppure '\0')
+ *   \retval NULL se errore (errno settato)
+ *   \retval l puntatore alla lista aperta
+ */
+nlist_t *nlistOpen(const char *path, char sep);
+
+/** Ritorna il prossimo nome della lista, saltando quelli vuoti. Il puntatore
+ *  resta valido fino alla chiamata successiva.
+ *
+ *   \retval name prossimo nome
+ *   \retval NULL a fine lista (errno == 0) oppure se errore (errno settato)
+ */
+const char *nlistNext(nlist_t *l);
+
+/** Da qui in poi, se *\param stop diventa diverso da 0, nlistNext smette di
+ *  aspettare l'ingresso (ad esempio uno standard input fermo) entro
+ *  NLIST_POLL_MS millisecondi e ritorna NULL con errno == ECANCELED.
+ */
+void nlistSetCancel(nlist_t *l, const volatile sig_atomic_t *stop);
+
+/** Chiude la lista e libera la memoria.
+ */
+void nlistClose(nlist_t *l);
+
+#endif /* NAMELIST_H */
@@ -0,0 +1,232 @@
+#define _GNU_SOURCE
+
+#include <endian.h>
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "netproto.h"
+
+/**
+ * @file netproto.c
+ * @brief File di implementazione del protocollo tra coordinatore e nodi Worker
+ */
+
+
+/* ------------------- funzioni di utilita' -------------------- */
+
+static int WriteN(int fd, const void *buf, size_t len) {
+    const char *p = buf;
+    while (len > 0) {
+	ssize_t r = send(fd, p, len, MSG_NOSIGNAL);
+	if (r == -1) {
+	    if (errno == EINTR) continue;
+	    return -1;
+	}
+	p += r;
+	len -= r;
+    }
+    return 0;
+}
+
+// ritorna 1 se letti tutti i byte, 0 se EOF prima del primo byte, -1 se errore
+static int ReadN(int fd, void *buf, size_t len) {
+    char *p = buf;
+    size_t got = 0;
+    while (got < len) {
+	ssize_t r = read(fd, p + got, len - got);
+	if (r == -1) {
+	    if (errno == EINTR) continue;
+	    return -1;
+	}
+	if (r == 0) {
+	    if (got == 0) return 0;
+	    errno = ECONNRESET;    // messaggio troncato
+	    return -1;
+	}
+	got += r;
+    }
+    return 1;
+}
+
+// separa "host:porta" (o solo "porta") in host e porta
+static int SplitAddr(const char *addr, char *host, size_t hlen, const char **port) {
+    const char *c = strrchr(addr, ':');
+    if (!c) {
+	host[0] = '\0';
+	*port = addr;
+	return 0;
+    }
+    if ((size_t)(c - addr) >= hlen) {
+	errno = ENAMETOOLONG;
+	return -1;
+    }
+    memcpy(host, addr, c - addr);
+    host[c - addr] = '\0';
+    *port = c + 1;
+    return 0;
+}
+
+static void NoDelay(int fd) {
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+/* ------------------- connessione ----------------------------- */
+
+int netListen(const char *addr) {
+    char host[256];
+    const char *port;
+    if (!addr || SplitAddr(addr, host, sizeof(host), &port) == -1) {
+	if (!addr) errno = EINVAL;
+	return -1;
+    }
+    struct addrinfo hints, *res;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    int r = getaddrinfo(host[0] ? host : NULL, port, &hints, &res);
+    if (r != 0) {
+	errno = EINVAL;
+	return -1;
+    }
+    int fd = -1;
+    for (struct addrinfo *a = res; a; a = a->ai_next) {
+	fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+	if (fd == -1) continue;
+	int one = 1;
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	if (bind(fd, a->ai_addr, a->ai_addrlen) == 0 && listen(fd, SOMAXCONN) == 0) break;
+	close(fd);
+	fd = -1;
+    }
+    freeaddrinfo(res);
+    return fd;
+}
+
+int netConnect(const char *addr) {
+    char host[256];
+    const char *port;
+    if (!addr || SplitAddr(addr, host, sizeof(host), &port) == -1) {
+	if (!addr) errno = EINVAL;
+	return -1;
+    }
+    struct addrinfo hints, *res;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    int r = getaddrinfo(host[0] ? host : "localhost", port, &hints, &res);
+    if (r != 0) {
+	errno = EINVAL;
+	return -1;
+    }
+    int fd = -1;
+    for (struct addrinfo *a = res; a; a = a->ai_next) {
+	fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+	if (fd == -1) continue;
+	if (connect(fd, a->ai_addr, a->ai_addrlen) == 0) break;
+	int myerrno = errno;
+	close(fd);
+	errno = myerrno;
+	fd = -1;
+    }
+    freeaddrinfo(res);
+    if (fd != -1) NoDelay(fd);
+    return fd;
+}
+
+/* ------------------- messaggi -------------------------------- */
+
+int netSendHello(int fd, uint32_t nthreads) {
+    uint32_t msg[2] = { htobe32(NET_MAGIC), htobe32(nthreads) };
+    return WriteN(fd, msg, sizeof(msg));
+}
+
+int netRecvHello(int fd, uint32_t *nthreads) {
+    uint32_t msg[2];
+    if (ReadN(fd, msg, sizeof(msg)) != 1) return -1;
+    if (be32toh(msg[0]) != NET_MAGIC) {
+	errno = EPROTO;
+	return -1;
+    }
+    *nthreads = be32toh(msg[1]);
+    NoDelay(fd);
+    return 0;
+}
+
+int netSendTask(int fd, uint64_t id, uint64_t size, uint32_t elem, int be, const char *name) {
+    size_t len = strlen(name);
+    char msg[sizeof(uint32_t) * 4 + sizeof(uint64_t) * 2 + len];
+    uint32_t type = htobe32(NET_TASK), blen = htobe32(len);
+    uint32_t belem = htobe32(elem), bbe = htobe32(be != 0);
+    uint64_t bid = htobe64(id), bsize = htobe64(size);
+    char *p = msg;
+    memcpy(p, &type, sizeof(type));   p += sizeof(type);
+    memcpy(p, &bid, sizeof(bid));     p += sizeof(bid);
+    memcpy(p, &bsize, sizeof(bsize)); p += sizeof(bsize);
+    memcpy(p, &belem, sizeof(belem)); p += sizeof(belem);
+    memcpy(p, &bbe, sizeof(bbe));     p += sizeof(bbe);
+    memcpy(p, &blen, sizeof(blen));   p += sizeof(blen);
+    memcpy(p, name, len);
+    return WriteN(fd, msg, sizeof(msg));
+}
+
+int netSendBye(int fd) {
+    uint32_t type = htobe32(NET_BYE);
+    return WriteN(fd, &type, sizeof(type));
+}
+
+int netRecvTask(int fd, uint32_t *type, uint64_t *id, uint64_t *size, uint32_t *elem, int *be,
+		char *name, size_t namelen) {
+    uint32_t t;
+    int r = ReadN(fd, &t, sizeof(t));
+    if (r != 1) return r;
+    *type = be32toh(t);
+    if (*type == NET_BYE) return 1;
+    if (*type != NET_TASK) {
+	errno = EPROTO;
+	return -1;
+    }
+    uint64_t bid, bsize;
+    uint32_t belem, bbe, blen;
+    if (ReadN(fd, &bid, sizeof(bid)) != 1 || ReadN(fd, &bsize, sizeof(bsize)) != 1 ||
+	ReadN(fd, &belem, sizeof(belem)) != 1 || ReadN(fd, &bbe, sizeof(bbe)) != 1 ||
+	ReadN(fd, &blen, sizeof(blen)) != 1)
+	return -1;
+    size_t len = be32toh(blen);
+    if (len >= namelen) {
+	errno = ENAMETOOLONG;
+	return -1;
+    }
+    if (len > 0 && ReadN(fd, name, len) != 1) return -1;
+    name[len] = '\0';
+    *id = be64toh(bid);
+    *size = be64toh(bsize);
+    *elem = be32toh(belem);
+    *be = be32toh(bbe) != 0;
+    return 1;
+}
+
+int netSendResult(int fd, uint64_t id, long result, int err) {
+    uint64_t msg[3] = { htobe64(id), htobe64((uint64_t)result), htobe64((uint64_t)err) };
+    return WriteN(fd, msg, sizeof(msg));
+}
+
+int netRecvResult(int fd, uint64_t *id, long *result, int *err) {
+    uint64_t msg[3];
+    int r = ReadN(fd, msg, sizeof(msg));
+    if (r != 1) return r;
+    *id = be64toh(msg[0]);
+    *result = (long)be64toh(msg[1]);
+    *err = (int)be64toh(msg[2]);
+    return 1;
+}
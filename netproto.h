@@ -0,0 +1,68 @@
+#if !defined(NETPROTO_H)
+#define NETPROTO_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** Protocollo tra il coordinatore e i nodi Worker remoti (TCP).
+ *
+ *  nodo -> coordinatore:  HELLO  magic (u32) | nthreads (u32)
+ *                         RESULT id (u64) | result (i64) | err (u64, 0 oppure l'errno
+ *                                del calcolo fallito: il nodo non termina)
+ *  coordinatore -> nodo:  TASK   type=NET_TASK (u32) | id (u64) | size (u64) | elem (u32) |
+ *                                be (u32) | len (u32) | nome
+ *                         BYE    type=NET_BYE (u32)
+ *
+ *  elem e be sono il tipo degli elementi (farm_type_t) e l'ordine dei byte del
+ *  file: li sceglie il coordinatore per ogni task, non le opzioni del nodo.
+ *
+ *  Tutti gli interi viaggiano in big-endian.
+ */
+
+#define NET_MAGIC  0x46524d32U    // "FRM2": RESULT porta anche l'errno, TASK il tipo degli elementi
+#define NET_TASK   1U
+#define NET_BYE    2U
+
+/** Apre un socket TCP in ascolto su \param addr ("porta" oppure "host:porta").
+ *
+ *   \retval fd descrittore del socket in ascolto
+ *   \retval -1 se errore (errno settato opportunamente)
+ */
+int netListen(const char *addr);
+
+/** Si connette al coordinatore \param addr ("host:porta").
+ *
+ *   \retval fd descrittore del socket connesso
+ *   \retval -1 se errore (errno settato opportunamente)
+ */
+int netConnect(const char *addr);
+
+int netSendHello(int fd, uint32_t nthreads);
+int netRecvHello(int fd, uint32_t *nthreads);
+
+int netSendTask(int fd, uint64_t id, uint64_t size, uint32_t elem, int be, const char *name);
+int netSendBye(int fd);
+
+/** Riceve un messaggio dal coordinatore. Per NET_TASK riempie \param id,
+ *  \param size, \param elem, \param be e \param name (di lunghezza massima
+ *  \param namelen, terminatore incluso).
+ *
+ *   \retval 1 se e' stato ricevuto un messaggio (\param type settato)
+ *   \retval 0 se la connessione e' stata chiusa
+ *   \retval -1 se errore (errno settato opportunamente)
+ */
+int netRecvTask(int fd, uint32_t *type, uint64_t *id, uint64_t *size, uint32_t *elem, int *be,
+		char *name, size_t namelen);
+
+int netSendResult(int fd, uint64_t id, long result, int err);
+
+/** Riceve un risultato da un nodo. \param err e' 0 oppure l'errno per cui il
+ *  nodo non ha potuto elaborare il file.
+ *
+ *   \retval 1 se e' stato ricevuto un risultato
+ *   \retval 0 se la connessione e' stata chiusa
+ *   \retval -1 se errore (errno settato opportunamente)
+ */
+int netRecvResult(int fd, uint64_t *id, long *result, int *err);
+
+#endif /* NETPROTO_H */
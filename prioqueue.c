@@ -0,0 +1,177 @@
+#define _GNU_SOURCE
+
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "util.h"
+#include "prioqueue.h"
+
+/**
+ * @file prioqueue.c
+ * @brief File di implementazione della coda con classi di priorita'
+ */
+
+
+/* ------------------- funzioni di utilita' -------------------- */
+
+static void Record(pq_stats_t *s, const struct timespec *from) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    uint64_t ns = (now.tv_sec - from->tv_sec) * 1000000000ULL + now.tv_nsec - from->tv_nsec;
+    s->count += 1;
+    s->total_ns += ns;
+    if (ns > s->max_ns) s->max_ns = ns;
+    size_t k = 0;
+    for (uint64_t us = ns / 1000; us > 0 && k < PQ_HIST - 1; us >>= 1) k++;
+    s->hist[k] += 1;
+}
+
+// estrae dalla classe di turno; chiamata con la lock presa e almeno un dato in coda
+static void *Take(PQueue_t *q) {
+    size_t c = q->cur;
+    if (q->left == 0 || q->qlen[c] == 0) {
+	do {
+	    c = c + 1 == q->nclasses ? 0 : c + 1;
+	} while (q->qlen[c] == 0);
+	q->cur = c;
+	q->left = q->weight[c];
+    }
+    q->left -= 1;
+    pq_item_t *it = &q->buf[c][q->head[c]];
+    void *data = it->data;
+    Record(&q->stats[c], &it->t);
+    it->data = NULL;
+    q->head[c] += (q->head[c]+1 >= q->qsize) ? (1-q->qsize) : 1;
+    q->qlen[c] -= 1;
+    q->total -= 1;
+    SIGNAL(&q->cfull);
+    return data;
+}
+
+/* ------------------- interfaccia della coda ------------------ */
+
+PQueue_t *initPQueue(size_t n, size_t nclasses, const unsigned *weights) {
+    if (n == 0 || nclasses == 0 || nclasses > PQ_MAX_CLASSES) {
+	errno = EINVAL;
+	return NULL;
+    }
+    PQueue_t *q = calloc(1, sizeof(PQueue_t));
+    if (!q) return NULL;
+    for (size_t c = 0; c < nclasses; c++) {
+	q->buf[c] = calloc(n, sizeof(pq_item_t));
+	if (!q->buf[c]) goto error;
+	q->weight[c] = weights && weights[c] > 0 ? weights[c] : 1;
+    }
+    if (pthread_mutex_init(&q->m, NULL) != 0) goto error;
+    if (pthread_cond_init(&q->cfull, NULL) != 0) {
+	pthread_mutex_destroy(&q->m);
+	goto error;
+    }
+    if (pthread_cond_init(&q->cempty, NULL) != 0) {
+	pthread_mutex_destroy(&q->m);
+	pthread_cond_destroy(&q->cfull);
+	goto error;
+    }
+    q->nclasses = nclasses;
+    q->qsize = n;
+    q->left = q->weight[0];
+    return q;
+ error:;
+    int myerrno = errno;
+    for (size_t c = 0; c < nclasses; c++) free(q->buf[c]);
+    free(q);
+    errno = myerrno;
+    return NULL;
+}
+
+void deletePQueue(PQueue_t *q, void (*F)(void *)) {
+    if (!q) {
+	errno = EINVAL;
+	return;
+    }
+    if (F) {
+	q->closed = 1;
+	void *data;
+	while ((data = pqPop(q))) F(data);
+    }
+    for (size_t c = 0; c < q->nclasses; c++) free(q->buf[c]);
+    pthread_mutex_destroy(&q->m);
+    pthread_cond_destroy(&q->cfull);
+    pthread_cond_destroy(&q->cempty);
+    free(q);
+}
+
+int pqPush(PQueue_t *q, size_t cls, void *data) {
+    if (!q || !data || cls >= q->nclasses) {
+	errno = EINVAL;
+	return -1;
+    }
+    LOCK(&q->m);
+    while (q->total == q->qsize && !q->closed) WAIT(&q->cfull, &q->m);
+    if (q->closed) {
+	UNLOCK(&q->m);
+	errno = EPIPE;
+	return -1;
+    }
+    size_t tail = (q->head[cls] + q->qlen[cls]) % q->qsize;
+    assert(q->buf[cls][tail].data == NULL);
+    q->buf[cls][tail].data = data;
+    clock_gettime(CLOCK_MONOTONIC, &q->buf[cls][tail].t);
+    q->qlen[cls] += 1;
+    q->total += 1;
+    SIGNAL(&q->cempty);
+    UNLOCK(&q->m);
+    return 0;
+}
+
+void *pqPop(PQueue_t *q) {
+    if (!q) {
+	errno = EINVAL;
+	return NULL;
+    }
+    LOCK(&q->m);
+    while (q->total == 0 && !q->closed) WAIT(&q->cempty, &q->m);
+    void *data = q->total > 0 ? Take(q) : NULL;
+    UNLOCK(&q->m);
+    return data;
+}
+
+void *pqTimedPop(PQueue_t *q, const struct timespec *abstime) {
+    if (!q || !abstime) {
+	errno = EINVAL;
+	return NULL;
+    }
+    LOCK(&q->m);
+    while (q->total == 0 && !q->closed) {
+	int r = pthread_cond_timedwait(&q->cempty, &q->m, abstime);
+	if (r == ETIMEDOUT && q->total == 0 && !q->closed) {
+	    UNLOCK(&q->m);
+	    errno = ETIMEDOUT;
+	    return NULL;
+	}
+    }
+    void *data = q->total > 0 ? Take(q) : NULL;
+    UNLOCK(&q->m);
+    errno = 0;
+    return data;
+}
+
+void pqClose(PQueue_t *q) {
+    if (!q) return;
+    LOCK(&q->m);
+    q->closed = 1;
+    BCAST(&q->cempty);
+    BCAST(&q->cfull);
+    UNLOCK(&q->m);
+}
+
+void pqStats(PQueue_t *q, size_t cls, pq_stats_t *out) {
+    if (!q || !out || cls >= q->nclasses) return;
+    LOCK(&q->m);
+    *out = q->stats[cls];
+    UNLOCK(&q->m);
+}
@@ -0,0 +1,94 @@
+#if !defined(PRIO_QUEUE_H)
+#define PRIO_QUEUE_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <time.h>
+
+/** Coda concorrente con classi di priorita' (0 la piu' urgente).
+ *
+ *  I qsize posti sono condivisi da tutte le classi, per cui la capacita' totale
+ *  non dipende dal numero delle classi. L'estrazione segue un round-robin pesato:
+ *  la classe corrente cede il turno dopo weight[c] estrazioni consecutive o
+ *  quando e' vuota, per cui una classe a bassa priorita' non resta mai ferma
+ *  del tutto. Per ogni classe viene misurata l'attesa in coda dei dati estratti.
+ */
+
+#if !defined(PQ_MAX_CLASSES)
+#define PQ_MAX_CLASSES 8
+#endif
+#define PQ_HIST 40
+
+typedef struct pq_stats {
+    uint64_t  count;
+    uint64_t  total_ns;
+    uint64_t  max_ns;
+    uint64_t  hist[PQ_HIST];    // hist[k]: attese tra 2^(k-1) e 2^k microsecondi
+} pq_stats_t;
+
+typedef struct pq_item {
+    void             *data;
+    struct timespec   t;        // istante dell'inserimento (CLOCK_MONOTONIC)
+} pq_item_t;
+
+typedef struct PQueue {
+    pq_item_t   *buf[PQ_MAX_CLASSES];
+    size_t       head[PQ_MAX_CLASSES];
+    size_t       qlen[PQ_MAX_CLASSES];
+    unsigned     weight[PQ_MAX_CLASSES];
+    pq_stats_t   stats[PQ_MAX_CLASSES];
+    size_t       nclasses;
+    size_t       qsize;         // posti in tutto (una classe sola puo' occuparli tutti)
+    size_t       total;         // dati in coda in tutte le classi
+    size_t       cur;           // classe di turno
+    unsigned     left;          // estrazioni rimaste alla classe di turno
+    int          closed;
+    pthread_mutex_t  m;
+    pthread_cond_t   cfull;
+    pthread_cond_t   cempty;
+} PQueue_t;
+
+
+/** Alloca una coda di \param n posti condivisi da \param nclasses classi.
+ *  \param weights puo' essere NULL (peso 1 per tutte le classi).
+ *
+ *   \retval NULL se errore (errno settato)
+ *   \retval q puntatore alla coda allocata
+ */
+PQueue_t *initPQueue(size_t n, size_t nclasses, const unsigned *weights);
+
+/** Cancella la coda, chiamando \param F (se non NULL) sui dati rimasti.
+ */
+void deletePQueue(PQueue_t *q, void (*F)(void *));
+
+/** Inserisce un dato nella classe \param cls, bloccandosi se la coda e' piena.
+ *
+ *   \retval 0 se successo
+ *   \retval -1 se errore (errno settato opportunamente; EPIPE se la coda e' chiusa)
+ */
+int pqPush(PQueue_t *q, size_t cls, void *data);
+
+/** Estrae il prossimo dato secondo il round-robin pesato.
+ *
+ *   \retval data puntatore al dato estratto
+ *   \retval NULL se la coda e' chiusa e vuota
+ */
+void *pqPop(PQueue_t *q);
+
+/** Come pqPop, aspettando al piu' fino al tempo assoluto \param abstime (CLOCK_REALTIME).
+ *
+ *   \retval NULL se il tempo e' scaduto (errno == ETIMEDOUT) o se la coda
+ *           e' chiusa e vuota (errno == 0)
+ */
+void *pqTimedPop(PQueue_t *q, const struct timespec *abstime);
+
+/** Chiude la coda: chi estrae riceve NULL quando tutte le classi sono vuote,
+ *  chi inserisce (anche se era gia' in attesa di un posto) riceve EPIPE.
+ */
+void pqClose(PQueue_t *q);
+
+/** Copia in \param out le statistiche d'attesa della classe \param cls.
+ */
+void pqStats(PQueue_t *q, size_t cls, pq_stats_t *out);
+
+#endif /* PRIO_QUEUE_H */
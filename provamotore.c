@@ -0,0 +1,94 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "engine.h"
+
+// usa il motore del farm (libfarm.a) senza il programma farm: un solo pool per
+// piu' giri di task su buffer in memoria, con i risultati confrontati con
+// quelli calcolati qui
+#define NTHREADS 3
+#define ROUNDS   5
+#define NTASKS   40
+
+typedef struct giro
+{
+  long atteso[NTASKS];
+  long ottenuto[NTASKS];
+  int consegnato[NTASKS];
+  size_t fuori; // callback con un indice di Worker non valido
+} giro_t;
+
+static void risultato(size_t worker, farm_task_t *t, void *arg)
+{
+  giro_t *g = arg;
+  // un task per id: ogni callback scrive il proprio slot, farmDrain fa il resto
+  g->ottenuto[t->id] = t->result;
+  g->consegnato[t->id] = t->err == 0;
+  if (worker >= NTHREADS)
+    __atomic_add_fetch(&g->fuori, 1, __ATOMIC_RELAXED);
+}
+
+int main(void)
+{
+  static giro_t g;
+  farm_opts_t o = {NTHREADS, 4, 1, NULL, 0, NULL, NULL, FARM_I64, 0, risultato, &g};
+  farm_engine_t *e = initFarm(&o);
+  if (e == NULL)
+  {
+    perror("initFarm");
+    return 1;
+  }
+
+  unsigned int seed = 331777;
+  int errori = 0;
+  for (int r = 0; r < ROUNDS; ++r)
+  {
+    long *buf[NTASKS];
+    memset(&g, 0, sizeof(g));
+    for (int k = 0; k < NTASKS; ++k)
+    {
+      long n = 100 + 37 * k + r;
+      buf[k] = malloc(n * sizeof(long));
+      if (buf[k] == NULL)
+      {
+        perror("malloc");
+        return 1;
+      }
+      for (long i = 0; i < n; ++i)
+      {
+        buf[k][i] = (long)(rand_r(&seed) / 12345678.0);
+        g.atteso[k] += i * buf[k][i];
+      }
+      if (farmSubmitBuffer(e, k, buf[k], n * sizeof(long), NULL) == -1)
+      {
+        perror("farmSubmitBuffer");
+        return 1;
+      }
+    }
+    farmDrain(e);
+    for (int k = 0; k < NTASKS; ++k)
+    {
+      if (!g.consegnato[k] || g.ottenuto[k] != g.atteso[k])
+      {
+        fprintf(stderr, "giro %d, task %d: atteso %ld, ottenuto %ld\n", r, k, g.atteso[k], g.ottenuto[k]);
+        errori++;
+      }
+      free(buf[k]);
+    }
+    if (g.fuori > 0)
+    {
+      fprintf(stderr, "giro %d: %zu risultati da un Worker fuori dal pool\n", r, g.fuori);
+      errori++;
+    }
+  }
+  deleteFarm(e);
+
+  if (errori > 0)
+    return 1;
+  fprintf(stdout, "%d giri da %d task sullo stesso pool: risultati corretti\n", ROUNDS, NTASKS);
+  return 0;
+}
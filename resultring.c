@@ -0,0 +1,125 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "resultring.h"
+
+/**
+ * @file resultring.c
+ * @brief File di implementazione dei ring SPSC condivisi tra Worker e Collector
+ */
+
+
+/* ------------------- funzioni di utilita' -------------------- */
+
+// le futex non sono FUTEX_PRIVATE perche' il segmento e' condiviso
+// tra il processo master e il processo Collector.
+
+static inline long FutexWait(_Atomic unsigned int *w, unsigned int val, const struct timespec *rel) {
+    return syscall(SYS_futex, (unsigned int *)w, FUTEX_WAIT, val, rel, NULL, 0);
+}
+static inline void FutexWake(_Atomic unsigned int *w, int n) {
+    syscall(SYS_futex, (unsigned int *)w, FUTEX_WAKE, n, NULL, NULL, 0);
+}
+
+static inline int RingEmpty(res_ring_t *r) {
+    return atomic_load_explicit(&r->head, memory_order_relaxed) ==
+	atomic_load_explicit(&r->tail, memory_order_acquire);
+}
+
+/* ------------------- interfaccia dei ring -------------------- */
+
+size_t ringSetSize(size_t n) {
+    return sizeof(ring_set_t) + n * sizeof(res_ring_t);
+}
+
+void initRingSet(ring_set_t *s, size_t n) {
+    memset(s, 0, ringSetSize(n));
+    s->nrings = n;
+}
+
+int ringPush(ring_set_t *s, size_t id, const res_record_t *rec) {
+    if (!s || !rec || id >= s->nrings) {
+	errno = EINVAL;
+	return -1;
+    }
+    res_ring_t *r = &s->rings[id];
+    size_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    while (tail - atomic_load_explicit(&r->head, memory_order_acquire) == RING_SLOTS) {
+	unsigned int seq = atomic_load(&s->space_seq);
+	atomic_fetch_add(&s->p_waiting, 1);
+	if (tail - atomic_load(&r->head) == RING_SLOTS) FutexWait(&s->space_seq, seq, NULL);
+	atomic_fetch_sub(&s->p_waiting, 1);
+    }
+    r->slot[tail % RING_SLOTS] = *rec;
+    atomic_store_explicit(&r->tail, tail + 1, memory_order_release);
+    /* La wake (e quindi la syscall) serve solo se il Collector
+     * ha trovato tutti i ring vuoti e si e' messo in attesa
+     */
+    atomic_fetch_add(&s->data_seq, 1);
+    if (atomic_load(&s->c_waiting)) FutexWake(&s->data_seq, 1);
+    return 0;
+}
+
+void ringClose(ring_set_t *s, size_t id) {
+    if (!s || id >= s->nrings) {
+	errno = EINVAL;
+	return;
+    }
+    atomic_store(&s->rings[id].closed, 1);
+    atomic_fetch_add(&s->data_seq, 1);
+    if (atomic_load(&s->c_waiting)) FutexWake(&s->data_seq, 1);
+}
+
+size_t ringDrain(ring_set_t *s, void (*F)(const res_record_t *, void *), void *arg, long timeout_ms) {
+    if (!s || !F) {
+	errno = EINVAL;
+	return 0;
+    }
+    struct timespec rel = { timeout_ms / 1000, (timeout_ms % 1000) * 1000000L };
+    while (1) {
+	size_t got = 0, open = 0;
+	for (size_t i = 0; i < s->nrings; i++) {
+	    res_ring_t *r = &s->rings[i];
+	    // closed va letto prima di tail: se era gia' chiuso,
+	    // tutti i suoi record sono visibili in questa passata
+	    int closed = atomic_load(&r->closed);
+	    size_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+	    size_t tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+	    for (; head != tail; head++, got++) F(&r->slot[head % RING_SLOTS], arg);
+	    atomic_store_explicit(&r->head, head, memory_order_release);
+	    if (!closed) open++;
+	}
+	if (got) {
+	    atomic_fetch_add(&s->space_seq, 1);
+	    if (atomic_load(&s->p_waiting)) FutexWake(&s->space_seq, INT_MAX);
+	    return got;
+	}
+	if (open == 0) {
+	    errno = 0;
+	    return 0;
+	}
+
+	unsigned int seq = atomic_load(&s->data_seq);
+	atomic_store(&s->c_waiting, 1);
+	// ricontrollo dopo aver settato c_waiting: un record (o una chiusura)
+	// arrivato nel frattempo non deve andare perso
+	size_t still_open = 0;
+	int ready = 0;
+	for (size_t i = 0; i < s->nrings; i++) {
+	    if (!RingEmpty(&s->rings[i])) ready = 1;
+	    if (!atomic_load(&s->rings[i].closed)) still_open++;
+	}
+	long r = 0;
+	if (!ready && still_open == open)
+	    r = FutexWait(&s->data_seq, seq, timeout_ms < 0 ? NULL : &rel);
+	atomic_store(&s->c_waiting, 0);
+	if (r == -1 && errno == ETIMEDOUT) return 0;
+    }
+}
@@ -0,0 +1,91 @@
+#if !defined(RESULT_RING_H)
+#define RESULT_RING_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#if !defined(RING_SLOTS)
+#define RING_SLOTS 64
+#endif
+
+#if !defined(RECORD_NAME_LEN)
+#define RECORD_NAME_LEN 1024
+#endif
+
+#define CACHE_LINE 64
+
+/** Record di dimensione fissa con il risultato del calcolo su un file.
+ *
+ */
+typedef struct res_record {
+    long             result;    // i 64 bit del risultato, interpretati secondo type
+    int              type;      // farm_type_t degli elementi del file
+    int              be;        // 1 se gli elementi erano big-endian (per il journal)
+    int              err;       // 0, oppure l'errno del calcolo fallito: niente stampa ne' journal
+    uint64_t         id;        // numero del task assegnato dal master
+    size_t           filesize;
+    struct timespec  mtime;
+    int              replay;    // 1 se il risultato viene dal journal
+    char             filename[RECORD_NAME_LEN];
+} res_record_t;
+
+/** Ring SPSC: un solo Worker produttore, il Collector come unico consumatore.
+ *  head e tail stanno su linee di cache diverse per evitare il false sharing.
+ */
+typedef struct res_ring {
+    _Atomic size_t head;
+    char           pad0[CACHE_LINE - sizeof(size_t)];
+    _Atomic size_t tail;
+    _Atomic int    closed;
+    char           pad1[CACHE_LINE - sizeof(size_t) - sizeof(int)];
+    res_record_t   slot[RING_SLOTS];
+} res_ring_t;
+
+/** Insieme dei ring, uno per Worker, allocato nel segmento condiviso.
+ *  data_seq e space_seq sono le parole futex su cui si bloccano
+ *  rispettivamente il Collector (tutti i ring vuoti) e i Worker (ring pieno).
+ */
+typedef struct ring_set {
+    _Atomic unsigned int data_seq;
+    _Atomic unsigned int space_seq;
+    _Atomic int          c_waiting;
+    _Atomic int          p_waiting;
+    size_t               nrings;
+    res_ring_t           rings[];
+} ring_set_t;
+
+
+/** Ritorna la dimensione in byte necessaria per un insieme di \param n ring.
+ */
+size_t ringSetSize(size_t n);
+
+/** Inizializza un insieme di \param n ring nella memoria puntata da \param s
+ *  (tipicamente un segmento MAP_SHARED). Deve essere chiamata prima della fork.
+ */
+void   initRingSet(ring_set_t *s, size_t n);
+
+/** Inserisce un record nel ring \param id. Se il ring e' pieno si blocca
+ *  finche' il Collector non libera almeno uno slot.
+ *
+ *   \retval 0 se successo
+ *   \retval -1 se errore (errno settato opportunamente)
+ */
+int    ringPush(ring_set_t *s, size_t id, const res_record_t *rec);
+
+/** Segnala che il Worker proprietario del ring \param id non produrra' piu' record.
+ */
+void   ringClose(ring_set_t *s, size_t id);
+
+/** Svuota tutti i ring chiamando \param F per ogni record estratto.
+ *  Se tutti i ring sono vuoti si blocca sulla futex finche' non arriva un record,
+ *  ma per non piu' di \param timeout_ms millisecondi (-1 per nessun limite).
+ *
+ *   \retval n numero di record estratti (> 0)
+ *   \retval 0 se tutti i ring sono chiusi e vuoti (errno == 0) o se il tempo
+ *           e' scaduto (errno == ETIMEDOUT)
+ */
+size_t ringDrain(ring_set_t *s, void (*F)(const res_record_t *, void *), void *arg, long timeout_ms);
+
+#endif /* RESULT_RING_H */
@@ -10,6 +10,11 @@ then
     echo "Compilare farm, eseguibile mancante!"
     exit 1
 fi
+if [ ! -e provamotore ];
+then
+    echo "Compilare provamotore, eseguibile mancante!"
+    exit 1
+fi
 
 #
 # il file expected.txt contiene i risultati attesi per i file
@@ -94,3 +99,262 @@ fi
 
 # possibile altro comando per verificare eventuali memory leaks
 #valgrind --leak-check=full --error-exitcode=1 --log-file=/dev/null ./farm file* 2>&1 > /dev/null
+
+# esecuzione con i risultati che passano dai ring in memoria condivisa
+./farm -r -n 8 -q 16 file* | grep "file*" | sort -nk 1 | awk '{print $1,$2}' | diff - expected.txt
+if [[ $? != 0 ]]; then
+    echo "test5 failed"
+else
+    echo "test5 passed"
+fi
+
+#
+# gli stessi file nel formato compatto devono dare gli stessi risultati
+#
+j=1
+for i in 100 150 19 116 2 1 117 3 5 17 4 16 19 8 10 111 12 13 14 15 18 20; do
+    ./generafile zfile$i.dat $(($i*11 + $j*117)) -z > /dev/null
+    j=$(($j+3))
+done
+./farm -n 4 -q 8 zfile* | grep "file*" | sed 's/zfile/file/' | sort -nk 1 | awk '{print $1,$2}' | diff - expected.txt
+if [[ $? != 0 ]]; then
+    echo "test6 failed"
+else
+    # un file di long che inizia per caso con l'header compatto resta un file di long
+    printf 'FRMZ\x80\x00\x00\x00\x05\x00\x00\x00\x00\x00\x00\x00' > finto.dat
+    if [[ $(./farm finto.dat 2>&1) != "5 finto.dat" ]]; then
+	echo "test6 failed"
+    else
+	echo "test6 passed"
+    fi
+    rm -f finto.dat
+fi
+
+#
+# esecuzione interrotta con SIGTERM e poi ripresa dal journal:
+# la seconda esecuzione deve produrre comunque tutti i risultati, e
+# l'ultima riga troncata del journal non deve inghiottire quelle nuove
+#
+rm -f journal.log
+./farm -n 1 -q 1 -t 300 -J journal.log file* > /dev/null &
+pid=$!
+sleep 2
+kill $pid
+wait $pid
+printf '12 3 4 5 troncata' >> journal.log
+./farm -n 4 -J journal.log file* | grep "file*" | sort -nk 1 | awk '{print $1,$2}' | diff - expected.txt
+if [[ $? != 0 ]] || grep -q troncata journal.log; then
+    echo "test7 failed"
+else
+    # un risultato arrivato mentre un file grande e' ancora in corso finisce sul
+    # disco entro un secondo anche se il farm viene ucciso con SIGKILL; un nome
+    # che inizia con uno spazio viene ritrovato uguale alla ripresa
+    cp file1.dat " file1.dat"
+    truncate -s 64G grande.dat
+    rm -f journal.log
+    ./farm -n 2 -J journal.log " file1.dat" grande.dat > /dev/null 2> attesa.txt &
+    pid=$!
+    sleep 2
+    pkill -KILL -P $pid
+    kill -KILL $pid
+    wait $pid 2> /dev/null
+    # la ripresa trova il file nel journal e non aggiunge righe
+    righe=$(grep -c " file1.dat$" journal.log)
+    # l'attesa del Collector senza risultati non deve essere un errore
+    if [[ $righe != 1 || $(./farm -J journal.log " file1.dat") != "153259244  file1.dat" ]] ||
+	   [[ $(wc -l < journal.log) != 1 ]] || [[ -s attesa.txt ]]; then
+	echo "test7 failed"
+    else
+	echo "test7 passed"
+    fi
+    rm -f " file1.dat" grande.dat attesa.txt
+fi
+
+#
+# coordinatore senza Worker locali e due nodi Worker sulla stessa macchina
+#
+./farm --worker-node localhost:5699 -n 2 &
+./farm --worker-node localhost:5699 -n 3 &
+./farm -n 0 -L 5699 file* | grep "file*" | sort -nk 1 | awk '{print $1,$2}' | diff - expected.txt
+if [[ $? != 0 ]]; then
+    echo "test8 failed"
+else
+    # un nodo lento ucciso con SIGKILL a meta' lavoro: i suoi task in volo
+    # tornano nella coda e li completa il nodo che si connette dopo
+    ./farm --worker-node localhost:5702 -n 1 -b 20000 &
+    vittima=$!
+    disown $vittima
+    (sleep 1; kill -KILL $vittima; ./farm --worker-node localhost:5702 -n 2) &
+    ./farm -n 0 -L 5702 file* 2> riassegnati.txt | grep "file*" | sort -nk 1 | awk '{print $1,$2}' | diff - expected.txt
+    if [[ $? != 0 ]] || ! grep -q "task riassegnati" riassegnati.txt; then
+	echo "test8 failed"
+    else
+	echo "test8 passed"
+    fi
+    rm -f riassegnati.txt
+fi
+wait
+
+#
+# lettura limitata a 400KB/s e 50 file/s: cambia il tempo, non i risultati
+#
+./farm -n 4 -b 400000 -F 50 file* | grep "file*" | sort -nk 1 | awk '{print $1,$2}' | diff - expected.txt
+if [[ $? != 0 ]]; then
+    echo "test9 failed"
+else
+    echo "test9 passed"
+fi
+
+#
+# lista dei file letta dallo standard input, separata da '\0'
+#
+ls file* | tr '\n' '\0' | ./farm -n 4 -0 -f - | grep "file*" | sort -nk 1 | awk '{print $1,$2}' | diff - expected.txt
+if [[ $? != 0 ]]; then
+    echo "test10 failed"
+else
+    echo "test10 passed"
+fi
+
+#
+# ordine deterministico dell'output: per risultato (senza sort) e per
+# ordine di input, con piu' Worker di quanti siano i file in coda.
+# Con -S 1 ogni risultato finisce in un run su file: l'ordine passa dalla fusione,
+# e con 110 run (piu' di EXTSORT_FANIN) servono due passate che non tengono
+# aperti piu' descrittori di quanti ne consenta ulimit -n 80
+#
+./farm -n 8 -q 16 -o result file* | grep "file*" | awk '{print $1,$2}' | diff - expected.txt &&
+    ./farm -n 8 -q 16 -o result -S 1 file* | grep "file*" | awk '{print $1,$2}' | diff - expected.txt &&
+    (ulimit -n 80; ./farm -n 8 -o result -S 1 file* file* file* file* file*) | awk '{print $1,$2}' |
+	diff - <(awk '{for (i = 0; i < 5; i++) print}' expected.txt)
+if [[ $? != 0 ]]; then
+    echo "test11 failed"
+else
+    ./farm -n 8 -q 16 -o input file* | grep "file*" | awk '{print $2}' | diff - <(ls file*)
+    if [[ $? != 0 ]]; then
+	echo "test11 failed"
+    else
+	echo "test11 passed"
+    fi
+fi
+
+#
+# finestra mappata di 8KB e budget globale di 16KB per 8 Worker:
+# i file (anche compatti) vengono letti a pezzi, il risultato non cambia
+#
+./farm -n 8 -w 8192 -m 16384 file* | grep "file*" | sort -nk 1 | awk '{print $1,$2}' | diff - expected.txt
+if [[ $? != 0 ]]; then
+    echo "test12 failed"
+else
+    ./farm -n 8 -w 8192 -m 16384 zfile* | grep "file*" | sed 's/zfile/file/' | sort -nk 1 | awk '{print $1,$2}' | diff - expected.txt
+    if [[ $? != 0 ]]; then
+	echo "test12 failed"
+    else
+	echo "test12 passed"
+    fi
+fi
+
+#
+# classi di priorita' dalla colonna della lista: i risultati non cambiano
+# e su stderr compare l'attesa in coda della classe urgente
+#
+(ls file1* | sed 's/^/0\t/'; ls file[2-9]* | sed 's/^/2\t/') > lista.txt
+./farm -n 2 -P -f lista.txt 2> attese.txt | grep "file*" | sort -nk 1 | awk '{print $1,$2}' | diff - expected.txt
+if [[ $? != 0 ]] || ! grep -q "^Classe 0:" attese.txt; then
+    echo "test13 failed"
+else
+    echo "test13 passed"
+fi
+rm -f lista.txt attese.txt
+
+#
+# tipi degli elementi e ordine dei byte: file piccoli con risultato noto
+#
+printf '\x01\x00\x00\x00\xfe\xff\xff\xff\x03\x00\x00\x00' > tipo_le.i32
+printf '\x00\x00\x00\x01\xff\xff\xff\xfe\x00\x00\x00\x03' > tipo_be.i32
+printf '\x00\x00\x00\x00\x00\x00\x00\x00\xff\xff\xff\xff\xff\xff\xff\xff' > tipo.u64
+printf '\x00\x00\x00\x00\x00\x00\xf8\x3f\x00\x00\x00\x00\x00\x00\xf8\x3f\x00\x00\x00\x00\x00\x00\xf8\x3f' > tipo_le.f64
+printf '\x3f\xf8\x00\x00\x00\x00\x00\x00\x3f\xf8\x00\x00\x00\x00\x00\x00\x3f\xf8\x00\x00\x00\x00\x00\x00' > tipo_be.f64
+(./farm -T i32 tipo_le.i32; ./farm -T i32 --be tipo_be.i32; ./farm -T u64 tipo.u64;
+ ./farm -T f64 tipo_le.f64; ./farm -T f64 --be -o result tipo_be.f64;
+ # il journal distingue anche l'ordine dei byte: con --be il file va ricalcolato
+ ./farm -J tipo.log -T i32 tipo_le.i32; ./farm -J tipo.log -T i32 --be tipo_le.i32;
+ # tipo e ordine dei byte li decide il coordinatore, anche per un nodo lanciato con altri
+ ./farm --worker-node localhost:5703 -n 1 -T f64 &
+ ./farm -n 0 -L 5703 -T i32 --be tipo_be.i32; wait) > tipi.txt
+printf '4 tipo_le.i32\n4 tipo_be.i32\n18446744073709551615 tipo.u64\n4.5 tipo_le.f64\n4.5 tipo_be.f64\n4 tipo_le.i32\n83886079 tipo_le.i32\n4 tipo_be.i32\n' | diff - tipi.txt
+if [[ $? != 0 ]]; then
+    echo "test14 failed"
+else
+    echo "test14 passed"
+fi
+rm -f tipo_* tipo.u64 tipo.log tipi.txt
+
+#
+# terminazione con lavoro in corso: con -b molto basso ogni file richiede
+# secondi, ma dopo SIGTERM il farm deve uscire con exit status 0 entro 100 ms.
+# Lo stesso vale per un coordinatore senza Worker locali ne' nodi connessi
+#
+ok=1
+for opts in "-n 2 -b 1000" "-n 0 -L 5700"; do
+    ./farm $opts file* > /dev/null 2> latenza.txt &
+    pid=$!
+    sleep 1
+    kill -TERM $pid
+    wait $pid
+    if [[ $? != 0 ]] || ! awk '/^Terminazione completata/ { ok = ($3 < 100) } END { exit !ok }' latenza.txt; then
+	ok=0
+    fi
+done
+# con -o input i risultati gia' pronti dopo il file interrotto vengono stampati
+truncate -s 64G grande.dat
+./farm -n 2 -o input grande.dat file1.dat > parziale.txt 2> /dev/null &
+pid=$!
+sleep 1
+kill -TERM $pid
+wait $pid
+if [[ $? != 0 ]] || ! grep -q " file1.dat$" parziale.txt; then
+    ok=0
+fi
+if [[ $ok != 1 ]]; then
+    echo "test15 failed"
+else
+    echo "test15 passed"
+fi
+rm -f latenza.txt grande.dat parziale.txt
+
+#
+# un nodo che non riesce ad aprire i file (qui i nomi relativi non esistono
+# nella sua directory) non termina: il coordinatore riporta gli errori
+#
+mkdir -p altrove
+(cd altrove && ../farm --worker-node localhost:5701 -n 1) &
+node=$!
+./farm -n 0 -L 5701 file1.dat file2.dat > risultati.txt 2> errori.txt
+rc=$?
+wait $node
+if [[ $rc != 0 || $? != 0 ]] || [[ -s risultati.txt ]] || [[ $(grep -c "ha fallito" errori.txt) != 2 ]]; then
+    echo "test16 failed"
+else
+    # lo stesso vale per un nome piu' lungo di quanto stia nel record del Collector
+    lungo=$(printf 'd%.0s' {1..250})
+    mkdir -p altrove/$lungo/$lungo/$lungo/$lungo/$lungo
+    cp file1.dat altrove/$lungo/$lungo/$lungo/$lungo/$lungo/file1.dat
+    ./farm -n 2 altrove/$lungo/$lungo/$lungo/$lungo/$lungo/file1.dat file2.dat > risultati.txt 2> errori.txt
+    if [[ $? != 0 ]] || ! grep -q "troppo lungo" errori.txt || [[ $(awk '{print $2}' risultati.txt) != file2.dat ]]; then
+	echo "test16 failed"
+    else
+	echo "test16 passed"
+    fi
+fi
+rm -rf altrove risultati.txt errori.txt
+
+#
+# il motore usato come libreria (libfarm.a): piu' giri di task su buffer
+# in memoria con lo stesso pool, senza passare dal programma farm
+#
+./provamotore > /dev/null
+if [[ $? != 0 ]]; then
+    echo "test17 failed"
+else
+    echo "test17 passed"
+fi
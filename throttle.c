@@ -0,0 +1,130 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "util.h"
+#include "throttle.h"
+
+/**
+ * @file throttle.c
+ * @brief File di implementazione del limitatore token bucket
+ */
+
+
+/* ------------------- funzioni di utilita' -------------------- */
+
+static void Refill(bucket_t *b) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double dt = (now.tv_sec - b->last.tv_sec) + (now.tv_nsec - b->last.tv_nsec) / 1e9;
+    b->last = now;
+    b->tokens += dt * b->rate;
+    if (b->tokens > b->burst) b->tokens = b->burst;
+}
+
+static void SetBucket(bucket_t *b, double rate, double burst) {
+    b->rate = rate > 0 ? rate : 0;
+    b->burst = burst > 0 ? burst : b->rate;
+    if (b->tokens > b->burst) b->tokens = b->burst;
+}
+
+// aspetta sulla condition variable al piu' il tempo necessario a maturare i token mancanti
+static void Take(throttle_t *t, bucket_t *b, double n) {
+    LOCK(&t->m);
+    while (b->rate > 0 && !t->cancelled) {
+	Refill(b);
+	double need = n < b->burst ? n : b->burst;
+	if (b->tokens >= need) {
+	    b->tokens -= n;
+	    break;
+	}
+	double wait = (need - b->tokens) / b->rate;
+	struct timespec abs;
+	clock_gettime(CLOCK_REALTIME, &abs);
+	long ns = abs.tv_nsec + (long)((wait - (long)wait) * 1e9);
+	abs.tv_sec += (long)wait + ns / 1000000000L;
+	abs.tv_nsec = ns % 1000000000L;
+	TWAIT(&t->c, &t->m, &abs);
+    }
+    UNLOCK(&t->m);
+}
+
+/* ------------------- interfaccia del limitatore ------------- */
+
+throttle_t *initThrottle(double bps, double burst, double fps) {
+    throttle_t *t = calloc(1, sizeof(throttle_t));
+    if (!t) return NULL;
+    if (pthread_mutex_init(&t->m, NULL) != 0) {
+	free(t);
+	return NULL;
+    }
+    if (pthread_cond_init(&t->c, NULL) != 0) {
+	pthread_mutex_destroy(&t->m);
+	free(t);
+	return NULL;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t->bytes.last);
+    t->files.last = t->bytes.last;
+    SetBucket(&t->bytes, bps, burst);
+    SetBucket(&t->files, fps, 0);
+    // si parte con il bucket pieno: il primo burst passa subito
+    t->bytes.tokens = t->bytes.burst;
+    t->files.tokens = t->files.burst;
+    return t;
+}
+
+void setThrottle(throttle_t *t, double bps, double burst, double fps) {
+    if (!t) return;
+    LOCK(&t->m);
+    Refill(&t->bytes);
+    Refill(&t->files);
+    SetBucket(&t->bytes, bps, burst);
+    SetBucket(&t->files, fps, 0);
+    BCAST(&t->c);
+    UNLOCK(&t->m);
+}
+
+int reloadThrottle(throttle_t *t, const char *path) {
+    if (!t || !path) {
+	errno = EINVAL;
+	return -1;
+    }
+    FILE *fp = fopen(path, "r");
+    if (!fp) return -1;
+    double bps = 0, burst = 0, fps = 0;
+    int n = fscanf(fp, "%lf %lf %lf", &bps, &burst, &fps);
+    fclose(fp);
+    if (n < 1 || bps < 0 || burst < 0 || fps < 0) {
+	errno = EINVAL;
+	return -1;
+    }
+    setThrottle(t, bps, burst, fps);
+    return 0;
+}
+
+void throttleBytes(throttle_t *t, size_t n) {
+    if (t) Take(t, &t->bytes, (double)n);
+}
+
+void throttleFile(throttle_t *t) {
+    if (t) Take(t, &t->files, 1);
+}
+
+void throttleCancel(throttle_t *t) {
+    if (!t) return;
+    LOCK(&t->m);
+    t->cancelled = 1;
+    BCAST(&t->c);
+    UNLOCK(&t->m);
+}
+
+void deleteThrottle(throttle_t *t) {
+    if (!t) return;
+    pthread_mutex_destroy(&t->m);
+    pthread_cond_destroy(&t->c);
+    free(t);
+}
@@ -0,0 +1,65 @@
+#if !defined(THROTTLE_H)
+#define THROTTLE_H
+
+#include <pthread.h>
+#include <time.h>
+
+/** Limitatore token bucket condiviso dai Worker, su byte letti e file al secondo.
+ *
+ *  Ogni bucket si riempie a 'rate' token al secondo fino a 'burst'. Una richiesta
+ *  aspetta finche' ci sono almeno min(quantita', burst) token e poi li consuma tutti:
+ *  il saldo puo' andare in negativo, cosi' una richiesta piu' grande del burst
+ *  non resta bloccata per sempre e la media nel lungo periodo resta 'rate'.
+ *  Un rate uguale a 0 vuol dire nessun limite.
+ */
+typedef struct bucket {
+    double           rate;
+    double           burst;
+    double           tokens;
+    struct timespec  last;
+} bucket_t;
+
+typedef struct throttle {
+    bucket_t         bytes;
+    bucket_t         files;
+    int              cancelled; // dopo throttleCancel nessuno aspetta piu'
+    pthread_mutex_t  m;
+    pthread_cond_t   c;
+} throttle_t;
+
+
+/** Alloca un limitatore. Se \param burst e' 0 si usa un secondo di \param bps.
+ *
+ *   \retval NULL se errore (errno settato)
+ *   \retval t puntatore al limitatore
+ */
+throttle_t *initThrottle(double bps, double burst, double fps);
+
+/** Cambia i limiti a runtime e risveglia i Worker in attesa.
+ */
+void setThrottle(throttle_t *t, double bps, double burst, double fps);
+
+/** Rilegge i limiti dal file di controllo \param path, nella forma
+ *  "byte_al_secondo [burst [file_al_secondo]]".
+ *
+ *   \retval 0 se successo
+ *   \retval -1 se errore (errno settato opportunamente)
+ */
+int reloadThrottle(throttle_t *t, const char *path);
+
+/** Consuma \param n byte dal bucket dei byte, bloccandosi se necessario.
+ *  Con \param t NULL ritorna subito.
+ */
+void throttleBytes(throttle_t *t, size_t n);
+
+/** Consuma un token dal bucket dei file, bloccandosi se necessario.
+ */
+void throttleFile(throttle_t *t);
+
+/** Risveglia i Worker in attesa e toglie ogni limite: serve a terminare in fretta.
+ */
+void throttleCancel(throttle_t *t);
+
+void deleteThrottle(throttle_t *t);
+
+#endif /* THROTTLE_H */